@@ -0,0 +1,134 @@
+
+#include <config.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "ai.h"
+
+/* Weights found by Yiyuan Lee's genetic tuning of the same four features. */
+const AiWeights AI_DEFAULT_WEIGHTS = {{-0.510066, 0.760666, -0.35663, -0.184483}};
+
+/**
+ * Work out the features of the board as it would be with p locked in.
+ * The board is only read: filled cells are copied into row bitmasks,
+ * with the piece added and completed rows left out.
+ */
+void ai_features(Board * b, Piece * p, double * features)
+{
+	uint32_t rows[HEIGHT];
+	for (int y=0; y<b->height; y++) {
+		rows[y] = board_row_mask(b, y);
+	}
+	for (int i=0; i<4; i++) {
+		rows[p->blocks[i]->y + p->center->y] |= 1u << (p->blocks[i]->x + p->center->x);
+	}
+
+	uint32_t full_row = (1u << b->width) - 1;
+	int complete_lines = 0;
+	// Rows that stay, packed towards the bottom.
+	uint32_t remaining[HEIGHT] = {0};
+	int next = b->height - 1;
+	for (int y=b->height-1; y>=0; y--) {
+		if (rows[y] == full_row) {
+			complete_lines++;
+		} else {
+			remaining[next--] = rows[y];
+		}
+	}
+
+	int aggregate_height = 0;
+	int holes = 0;
+	int bumpiness = 0;
+	int previous_height = 0;
+	for (int x=0; x<b->width; x++) {
+		int height = 0;
+		for (int y=0; y<b->height; y++) {
+			if (remaining[y] & (1u << x)) {
+				if (height == 0) {
+					height = b->height - y;
+				}
+			} else if (height != 0) {
+				holes++;
+			}
+		}
+		aggregate_height += height;
+		if (x > 0) {
+			bumpiness += abs(height - previous_height);
+		}
+		previous_height = height;
+	}
+
+	features[AI_AGGREGATE_HEIGHT] = aggregate_height;
+	features[AI_COMPLETE_LINES] = complete_lines;
+	features[AI_HOLES] = holes;
+	features[AI_BUMPINESS] = bumpiness;
+}
+
+/** Score the board as it would be with p locked in; higher is better. */
+double ai_evaluate(Board * b, Piece * p, const AiWeights * w)
+{
+	double features[AI_FEATURE_COUNT];
+	ai_features(b, p, features);
+	double score = 0;
+	for (int i=0; i<AI_FEATURE_COUNT; i++) {
+		score += w->weights[i] * features[i];
+	}
+	return score;
+}
+
+/** 
+ * Find the best place to lock p, which must be in its spawn orientation. 
+ * Returns false if the piece has nowhere to go.
+ */
+bool ai_find_best_placement(Board * b, Piece * p, const AiWeights * w, Placement * best)
+{
+	Placement placements[MOVEGEN_MAX_PLACEMENTS];
+	int count = movegen_find_placements(b, p, placements);
+	double best_score = 0;
+	Piece * trial = piece_copy(p);
+	int rotation = 0;
+	for (int i=0; i<count; i++) {
+		while (rotation != placements[i].rotation) {
+			piece_rotate_clockwise(trial);
+			rotation = (rotation + 1) % 4;
+		}
+		trial->center->x = placements[i].x;
+		trial->center->y = placements[i].y;
+		double score = ai_evaluate(b, trial, w);
+		if (i == 0 || score > best_score) {
+			best_score = score;
+			*best = placements[i];
+		}
+	}
+	piece_free(trial);
+	return count > 0;
+}
+
+/** 
+ * Lock the current piece where the AI likes it best, and bring in the
+ * next piece. Returns false once the game is over.
+ */
+bool ai_play_move(Board * b, const AiWeights * w)
+{
+	Placement best;
+	if (!ai_find_best_placement(b, b->current_piece, w, &best)) {
+		board_top_out(b, TOP_OUT_SPAWN_BLOCKED);
+		return false;
+	}
+	movegen_apply(b->current_piece, &best);
+	board_push_current_piece_down(b);
+	return !b->is_done;
+}
+
+/** 
+ * Play until the game is over or max_pieces have been locked.
+ * Returns the number of pieces locked.
+ */
+int ai_play_game(Board * b, const AiWeights * w, int max_pieces)
+{
+	int pieces = 0;
+	while (pieces < max_pieces && !b->is_done) {
+		ai_play_move(b, w);
+		pieces++;
+	}
+	return pieces;
+}
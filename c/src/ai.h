@@ -0,0 +1,33 @@
+/**
+ * A computer player that picks the placement scoring best under a
+ * weighted sum of board features.
+ */
+
+#include "pieces.h"
+#include "movegen.h"
+
+#ifndef AI_H
+#define AI_H
+
+/** Features a placement is judged by, indexing AiWeights.weights. */
+enum {
+	AI_AGGREGATE_HEIGHT = 0,
+	AI_COMPLETE_LINES,
+	AI_HOLES,
+	AI_BUMPINESS,
+	AI_FEATURE_COUNT
+};
+
+typedef struct {
+	double weights[AI_FEATURE_COUNT];
+} AiWeights ;
+
+extern const AiWeights AI_DEFAULT_WEIGHTS;
+
+void ai_features(Board * b, Piece * p, double * features);
+double ai_evaluate(Board * b, Piece * p, const AiWeights * w);
+bool ai_find_best_placement(Board * b, Piece * p, const AiWeights * w, Placement * best);
+bool ai_play_move(Board * b, const AiWeights * w);
+int ai_play_game(Board * b, const AiWeights * w, int max_pieces);
+
+#endif /* AI_H */
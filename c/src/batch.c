@@ -0,0 +1,159 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "pieces.h"
+#include "ai.h"
+#include "stats.h"
+
+/**
+ * tetris-batch: play many AI games on all cores and report on them:
+ * score, line and game length distributions, piece frequencies, clears
+ * and why games ended. Each thread gathers its own statistics from board
+ * events, and they are merged once every game is done.
+ *
+ * With -r, reports from earlier runs are merged and printed instead.
+ */
+
+typedef struct {
+	AiWeights weights;
+	unsigned int seed;
+	int game_count;
+	int max_pieces;
+	int next_game;
+	pthread_mutex_t lock;
+} Batch ;
+
+typedef struct {
+	Batch * batch;
+	GameStats stats;
+	pthread_t thread;
+} Worker ;
+
+static void * worker_run(void * arg)
+{
+	Worker * worker = arg;
+	Batch * batch = worker->batch;
+	Board * b = board_create_seeded(batch->seed);
+	StatsRecorder recorder;
+	stats_recorder_attach(&recorder, &worker->stats, b);
+	for (;;) {
+		pthread_mutex_lock(&batch->lock);
+		int i = batch->next_game++;
+		pthread_mutex_unlock(&batch->lock);
+		if (i >= batch->game_count) {
+			break;
+		}
+		board_reset(b, batch->seed + i);
+		ai_play_game(b, &batch->weights, batch->max_pieces);
+		stats_recorder_stop(&recorder, b);
+	}
+	board_free(b);
+	return NULL;
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: tetris-batch [-t threads] [-n games] [-p max_pieces] [-s seed] [-w weights] [-o report]\n"
+			"       tetris-batch -r report...\n"
+			"  -w weights  %i AI weights, as printed by tetris-tuner\n"
+			"  -o report   also write the statistics to a report file\n"
+			"  -r          merge and print earlier reports\n", AI_FEATURE_COUNT);
+	exit(EXIT_FAILURE);
+}
+
+/** Merge the reports named on the command line and print the total. */
+static int print_reports(int count, char * paths[])
+{
+	GameStats total;
+	GameStats * report = malloc(sizeof(GameStats));
+	stats_init(&total);
+	for (int i=0; i<count; i++) {
+		FILE * file = fopen(paths[i], "rb");
+		bool ok = file != NULL && stats_read(report, file);
+		if (file != NULL) {
+			fclose(file);
+		}
+		if (!ok) {
+			fprintf(stderr, "Couldn't read %s\n", paths[i]);
+			free(report);
+			return EXIT_FAILURE;
+		}
+		stats_merge(&total, report);
+	}
+	stats_print(&total, stdout);
+	free(report);
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+	Batch batch;
+	batch.weights = AI_DEFAULT_WEIGHTS;
+	batch.seed = 1;
+	batch.game_count = 1000;
+	batch.max_pieces = 2000;
+	batch.next_game = 0;
+	int thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+	const char * report_file = NULL;
+	bool read_reports = false;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "t:n:p:s:w:o:r")) != -1) {
+		double * w = batch.weights.weights;
+		switch (opt) {
+		case 't': thread_count = atoi(optarg); break;
+		case 'n': batch.game_count = atoi(optarg); break;
+		case 'p': batch.max_pieces = atoi(optarg); break;
+		case 's': batch.seed = strtoul(optarg, NULL, 10); break;
+		case 'o': report_file = optarg; break;
+		case 'r': read_reports = true; break;
+		case 'w':
+			if (sscanf(optarg, "%lf %lf %lf %lf", &w[0], &w[1], &w[2], &w[3]) != AI_FEATURE_COUNT) {
+				usage();
+			}
+			break;
+		default: usage();
+		}
+	}
+	if (read_reports) {
+		if (optind == argc) {
+			usage();
+		}
+		return print_reports(argc - optind, argv + optind);
+	}
+	if (optind != argc || thread_count < 1 || batch.game_count < 1 || batch.max_pieces < 1) {
+		usage();
+	}
+	pthread_mutex_init(&batch.lock, NULL);
+
+	Worker * workers = calloc(thread_count, sizeof(Worker));
+	for (int i=0; i<thread_count; i++) {
+		workers[i].batch = &batch;
+		stats_init(&workers[i].stats);
+		pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]);
+	}
+	GameStats * total = malloc(sizeof(GameStats));
+	stats_init(total);
+	for (int i=0; i<thread_count; i++) {
+		pthread_join(workers[i].thread, NULL);
+		stats_merge(total, &workers[i].stats);
+	}
+	stats_print(total, stdout);
+
+	int result = EXIT_SUCCESS;
+	if (report_file != NULL) {
+		FILE * file = fopen(report_file, "wb");
+		if (file == NULL || !stats_write(total, file) || fclose(file) != 0) {
+			fprintf(stderr, "Couldn't write %s\n", report_file);
+			result = EXIT_FAILURE;
+		}
+	}
+	free(total);
+	free(workers);
+	return result;
+}
@@ -0,0 +1,60 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <config.h>
+#include <stdio.h>
+#include "cli.h"
+
+/** 
+ * Turn a string of PIECE_LETTERS into PieceType values. Returns the
+ * number of pieces, or -1 if the string is empty, longer than max_length
+ * or has other letters in it.
+ */
+int cli_parse_pieces(const char * text, int * sequence, int max_length)
+{
+	int length = 0;
+	for (; text[length] != '\0'; length++) {
+		if (length == max_length) {
+			return -1;
+		}
+		sequence[length] = piece_type_from_letter(text[length]);
+		if (sequence[length] < 0) {
+			return -1;
+		}
+	}
+	return length > 0 ? length : -1;
+}
+
+/** 
+ * An empty board, or one read from board_file in board_print format if
+ * it isn't NULL. Returns NULL, having said why, if the file can't be read.
+ */
+Board * cli_start_board(const char * board_file)
+{
+	Board * b = board_create_seeded(1);
+	if (board_file == NULL) {
+		return b;
+	}
+	FILE * file = fopen(board_file, "r");
+	bool ok = file != NULL && board_read(b, file);
+	if (file != NULL) {
+		fclose(file);
+	}
+	if (!ok) {
+		fprintf(stderr, "Couldn't read %s\n", board_file);
+		board_free(b);
+		return NULL;
+	}
+	return b;
+}
+
+void cli_start_timer(struct timespec * start)
+{
+	clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+double cli_seconds_since(struct timespec * start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
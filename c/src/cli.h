@@ -0,0 +1,17 @@
+/**
+ * Helpers shared by the command line tools: reading piece sequences and
+ * starting boards from arguments, and timing runs.
+ */
+
+#include <time.h>
+#include "pieces.h"
+
+#ifndef CLI_H
+#define CLI_H
+
+int cli_parse_pieces(const char * text, int * sequence, int max_length);
+Board * cli_start_board(const char * board_file);
+void cli_start_timer(struct timespec * start);
+double cli_seconds_since(struct timespec * start);
+
+#endif /* CLI_H */
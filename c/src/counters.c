@@ -0,0 +1,130 @@
+
+#include <config.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "counters.h"
+
+#ifdef TETRIS_COUNTERS
+
+static const char * COUNTER_NAMES[COUNTER_COUNT] = {
+	"valid placement checks", "piece copies", "allocations", "rotations", "locks",
+	"single clears", "double clears", "triple clears", "clears of 4+ rows"
+};
+
+/** One thread's counts, kept on a list so they can be added up. */
+typedef struct _slot {
+	Counters counters;
+	struct _slot * next;
+} Slot ;
+
+static pthread_mutex_t slots_lock = PTHREAD_MUTEX_INITIALIZER;
+static Slot * live_slots = NULL;
+static Slot * free_slots = NULL;
+/* Counts from threads that have exited. */
+static Counters retired;
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t slot_key;
+static __thread Slot * thread_slot = NULL;
+
+static void remove_slot(Slot ** list, Slot * slot)
+{
+	while (*list != slot) {
+		list = &(*list)->next;
+	}
+	*list = slot->next;
+}
+
+/** When a thread exits, keep its counts and let the next thread reuse its slot. */
+static void retire_slot(void * data)
+{
+	Slot * slot = data;
+	pthread_mutex_lock(&slots_lock);
+	for (int i=0; i<COUNTER_COUNT; i++) {
+		retired.values[i] += slot->counters.values[i];
+	}
+	remove_slot(&live_slots, slot);
+	slot->next = free_slots;
+	free_slots = slot;
+	pthread_mutex_unlock(&slots_lock);
+}
+
+static void create_key()
+{
+	pthread_key_create(&slot_key, retire_slot);
+}
+
+static Slot * claim_slot()
+{
+	pthread_once(&key_once, create_key);
+	pthread_mutex_lock(&slots_lock);
+	Slot * slot = free_slots;
+	if (slot != NULL) {
+		free_slots = slot->next;
+	} else {
+		slot = malloc(sizeof(Slot));
+	}
+	for (int i=0; i<COUNTER_COUNT; i++) {
+		slot->counters.values[i] = 0;
+	}
+	slot->next = live_slots;
+	live_slots = slot;
+	pthread_mutex_unlock(&slots_lock);
+	pthread_setspecific(slot_key, slot);
+	return slot;
+}
+
+/** Add to one of this thread's counters. Use COUNT() rather than calling this. */
+void counter_add(int counter, unsigned long long amount)
+{
+	Slot * slot = thread_slot;
+	if (slot == NULL) {
+		slot = thread_slot = claim_slot();
+	}
+	// Only this thread writes the slot; the atomic store just keeps readers from seeing a torn value.
+	unsigned long long * value = &slot->counters.values[counter];
+	__atomic_store_n(value, *value + amount, __ATOMIC_RELAXED);
+}
+
+/** Add up every thread's counters, including threads that have exited. */
+void counters_read(Counters * totals)
+{
+	pthread_mutex_lock(&slots_lock);
+	*totals = retired;
+	for (Slot * slot = live_slots; slot != NULL; slot = slot->next) {
+		for (int i=0; i<COUNTER_COUNT; i++) {
+			totals->values[i] += __atomic_load_n(&slot->counters.values[i], __ATOMIC_RELAXED);
+		}
+	}
+	pthread_mutex_unlock(&slots_lock);
+}
+
+/** 
+ * Start counting from zero. Counts made by other threads while this runs
+ * may or may not be kept.
+ */
+void counters_reset()
+{
+	pthread_mutex_lock(&slots_lock);
+	for (int i=0; i<COUNTER_COUNT; i++) {
+		retired.values[i] = 0;
+	}
+	for (Slot * slot = live_slots; slot != NULL; slot = slot->next) {
+		for (int i=0; i<COUNTER_COUNT; i++) {
+			__atomic_store_n(&slot->counters.values[i], 0, __ATOMIC_RELAXED);
+		}
+	}
+	pthread_mutex_unlock(&slots_lock);
+}
+
+/** Write every counter to out, one per line. */
+void counters_print(FILE * out)
+{
+	Counters totals;
+	counters_read(&totals);
+	for (int i=0; i<COUNTER_COUNT; i++) {
+		fprintf(out, "%-24s %llu\n", COUNTER_NAMES[i], totals.values[i]);
+	}
+}
+
+#endif /* TETRIS_COUNTERS */
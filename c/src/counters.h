@@ -0,0 +1,57 @@
+/**
+ * Counters for the engine's hot paths.
+ *
+ * Configure with --enable-counters to turn them on; otherwise they are
+ * compiled out completely and COUNT() and the functions below do nothing.
+ * Each thread increments its own slot, so counting never contends;
+ * counters_read() adds the slots up.
+ */
+
+#include <stdio.h>
+
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+enum {
+	COUNTER_VALID_PLACEMENT_CHECKS = 0,
+	COUNTER_PIECE_COPIES,
+	COUNTER_ALLOCATIONS,
+	COUNTER_ROTATIONS,
+	COUNTER_LOCKS,
+	/* Locks that cleared 1, 2, 3 and 4 or more rows; in that order. */
+	COUNTER_CLEARS_1,
+	COUNTER_CLEARS_2,
+	COUNTER_CLEARS_3,
+	COUNTER_CLEARS_4,
+	COUNTER_COUNT
+};
+
+typedef struct {
+	unsigned long long values[COUNTER_COUNT];
+} Counters ;
+
+#ifdef TETRIS_COUNTERS
+void counters_read(Counters * totals);
+void counters_reset();
+void counters_print(FILE * out);
+void counter_add(int counter, unsigned long long amount);
+
+#define COUNT(counter) counter_add((counter), 1)
+#define COUNT_N(counter, amount) counter_add((counter), (amount))
+#else
+/* Without counters every count reads as 0 and printing does nothing. */
+static inline void counters_read(Counters * totals)
+{
+	for (int i=0; i<COUNTER_COUNT; i++) {
+		totals->values[i] = 0;
+	}
+}
+
+static inline void counters_reset() {}
+static inline void counters_print(FILE * out) { (void) out; }
+
+#define COUNT(counter) ((void) 0)
+#define COUNT_N(counter, amount) ((void) 0)
+#endif
+
+#endif /* COUNTERS_H */
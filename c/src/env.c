@@ -0,0 +1,115 @@
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include "env.h"
+
+/** Pick the seed for the next game started in the batch. */
+static unsigned int env_next_seed(EnvBatch * batch)
+{
+	// Numerical Recipes LCG; only needs to give each game a distinct seed.
+	batch->seed_state = batch->seed_state * 1664525u + 1013904223u;
+	return batch->seed_state;
+}
+
+EnvBatch * env_batch_create(int count, unsigned int seed)
+{
+	EnvBatch * batch = malloc(sizeof(EnvBatch));
+	batch->count = count;
+	batch->seed_state = seed;
+	batch->boards = malloc(sizeof(Board *) * count);
+	for (int i=0; i<count; i++) {
+		batch->boards[i] = board_create_seeded(env_next_seed(batch));
+	}
+	return batch;
+}
+
+void env_batch_free(EnvBatch * batch)
+{
+	for (int i=0; i<batch->count; i++) {
+		board_free(batch->boards[i]);
+	}
+	free(batch->boards);
+	free(batch);
+}
+
+/** 
+ * Write the board into ENV_OBSERVATION_SIZE bytes of out, marking placed
+ * blocks and the falling piece.
+ */
+void env_write_observation(Board * b, uint8_t * out)
+{
+	for (int y=0; y<b->height; y++) {
+		for (int x=0; x<b->width; x++) {
+			out[y * b->width + x] = 
+				board_cell(b, x, y) != 0 ? ENV_CELL_PLACED : ENV_CELL_EMPTY;
+		}
+	}
+	Piece * p = b->current_piece;
+	for (int i=0; i<4; i++) {
+		int x = p->blocks[i]->x + p->center->x;
+		int y = p->blocks[i]->y + p->center->y;
+		// Pieces spawn partially above the board.
+		if (y >= 0) {
+			out[y * b->width + x] = ENV_CELL_PIECE;
+		}
+	}
+}
+
+/** Write the current observation of every game, without stepping. */
+void env_batch_observe(EnvBatch * batch, uint8_t * observations)
+{
+	for (int i=0; i<batch->count; i++) {
+		env_write_observation(batch->boards[i], observations + i * ENV_OBSERVATION_SIZE);
+	}
+}
+
+static void env_apply_action(Board * b, int action)
+{
+	switch (action) {
+	case ENV_ACTION_LEFT:
+		board_try_move(b, &piece_left, &piece_right);
+		break;
+	case ENV_ACTION_RIGHT:
+		board_try_move(b, &piece_right, &piece_left);
+		break;
+	case ENV_ACTION_ROTATE_CLOCKWISE:
+		board_try_move(b, &piece_rotate_clockwise, &piece_rotate_counter_clockwise);
+		break;
+	case ENV_ACTION_ROTATE_COUNTER_CLOCKWISE:
+		board_try_move(b, &piece_rotate_counter_clockwise, &piece_rotate_clockwise);
+		break;
+	case ENV_ACTION_DROP:
+		while (board_try_move(b, &piece_down, &piece_up)) {};
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * Step every game in the batch by one action followed by one gravity tick.
+ *
+ * actions holds one action per game. The reward of a game is the score it
+ * gained during the step. A game that ends is reset straight away: its
+ * done flag is set and its observation is the first one of the new game.
+ * observations, rewards and dones are caller-owned buffers of count
+ * entries. Nothing is allocated per step: boards turn their current piece
+ * into the next one in place, on spawns and resets alike.
+ */
+void env_batch_step(EnvBatch * batch, const int32_t * actions,
+					uint8_t * observations, float * rewards, uint8_t * dones)
+{
+	for (int i=0; i<batch->count; i++) {
+		Board * b = batch->boards[i];
+		int old_score = b->score;
+		env_apply_action(b, actions[i]);
+		board_push_current_piece_down(b);
+		rewards[i] = (float) (b->score - old_score);
+		dones[i] = b->is_done;
+		if (b->is_done) {
+			board_reset(b, env_next_seed(batch));
+		}
+		env_write_observation(b, observations + i * ENV_OBSERVATION_SIZE);
+	}
+}
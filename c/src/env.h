@@ -0,0 +1,48 @@
+/**
+ * A batch of independent games, stepped together.
+ *
+ * This is a small C ABI meant for reinforcement-learning trainers: all
+ * inputs and outputs are flat arrays of fixed width types owned by the
+ * caller, so it can be driven from ctypes/cffi without per-board calls.
+ */
+
+#include <stdint.h>
+#include "pieces.h"
+
+#ifndef ENV_H
+#define ENV_H
+
+/** Number of bytes one observation takes in the observations buffer. */
+#define ENV_OBSERVATION_SIZE (WIDTH * HEIGHT)
+
+/** Observation cell values. Observations are row major, (0,0) top-left. */
+#define ENV_CELL_EMPTY 0
+#define ENV_CELL_PLACED 1
+#define ENV_CELL_PIECE 2
+
+/** Actions that can be taken on a game for one step. */
+enum {
+	ENV_ACTION_NONE = 0,
+	ENV_ACTION_LEFT,
+	ENV_ACTION_RIGHT,
+	ENV_ACTION_ROTATE_CLOCKWISE,
+	ENV_ACTION_ROTATE_COUNTER_CLOCKWISE,
+	ENV_ACTION_DROP,
+	ENV_ACTION_COUNT
+};
+
+typedef struct {
+	int count;
+	/* Used to derive the seed of each new game. */
+	unsigned int seed_state;
+	Board ** boards;
+} EnvBatch ;
+
+EnvBatch * env_batch_create(int count, unsigned int seed);
+void env_batch_free(EnvBatch * batch);
+void env_batch_observe(EnvBatch * batch, uint8_t * observations);
+void env_batch_step(EnvBatch * batch, const int32_t * actions,
+					uint8_t * observations, float * rewards, uint8_t * dones);
+void env_write_observation(Board * b, uint8_t * out);
+
+#endif /* ENV_H */
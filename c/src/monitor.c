@@ -0,0 +1,151 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "pieces.h"
+#include "ai.h"
+#include "term_render.h"
+
+/**
+ * tetris-monitor: run AI games at full speed and watch them in a terminal.
+ *
+ * Each board has a lock shared by the simulation thread playing it and the
+ * display thread. The display thread holds it only long enough to draw that
+ * board into the next frame, at most fps times a second, so a simulation
+ * thread waits for the screen at most one board's drawing at a time.
+ */
+
+typedef struct {
+	Board * board;
+	pthread_mutex_t lock;
+	int games;
+} Game ;
+
+typedef struct {
+	Game * games;
+	int game_count;
+	int first;
+	int step;
+	pthread_t thread;
+} Simulator ;
+
+/* 
+ * Cleared by the signal handler and the main thread, read by the
+ * simulators; lock-free atomics are safe in both places.
+ */
+static int running = 1;
+
+static bool is_running()
+{
+	return __atomic_load_n(&running, __ATOMIC_RELAXED);
+}
+
+static void stop(int sig)
+{
+	(void) sig;
+	__atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+}
+
+static void * simulate(void * arg)
+{
+	Simulator * sim = arg;
+	while (is_running()) {
+		for (int i=sim->first; i<sim->game_count; i+=sim->step) {
+			Game * g = &sim->games[i];
+			pthread_mutex_lock(&g->lock);
+			if (!ai_play_move(g->board, &AI_DEFAULT_WEIGHTS)) {
+				board_reset(g->board, g->board->rng_state);
+				g->games++;
+			}
+			pthread_mutex_unlock(&g->lock);
+		}
+	}
+	return NULL;
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: tetris-monitor [-n boards] [-a across] [-f fps] [-t threads] [-s seed] [-d seconds]\n");
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	int game_count = 8;
+	int across = 4;
+	int fps = 20;
+	int thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int seed = time(NULL);
+	int duration = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:a:f:t:s:d:")) != -1) {
+		switch (opt) {
+		case 'n': game_count = atoi(optarg); break;
+		case 'a': across = atoi(optarg); break;
+		case 'f': fps = atoi(optarg); break;
+		case 't': thread_count = atoi(optarg); break;
+		case 's': seed = strtoul(optarg, NULL, 10); break;
+		case 'd': duration = atoi(optarg); break;
+		default: usage();
+		}
+	}
+	if (optind != argc || game_count < 1 || across < 1 || fps < 1 || thread_count < 1 || duration < 0) {
+		usage();
+	}
+	if (thread_count > game_count) {
+		thread_count = game_count;
+	}
+
+	Game * games = malloc(sizeof(Game) * game_count);
+	for (int i=0; i<game_count; i++) {
+		games[i].board = board_create_seeded(seed + i);
+		games[i].games = 0;
+		pthread_mutex_init(&games[i].lock, NULL);
+	}
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+
+	Simulator * sims = malloc(sizeof(Simulator) * thread_count);
+	for (int i=0; i<thread_count; i++) {
+		sims[i].games = games;
+		sims[i].game_count = game_count;
+		sims[i].first = i;
+		sims[i].step = thread_count;
+		pthread_create(&sims[i].thread, NULL, simulate, &sims[i]);
+	}
+
+	TermRenderer * tr = term_renderer_create(across, (game_count + across - 1) / across);
+	printf("\x1b[2J\x1b[?25l");
+	struct timespec frame = {0, 1000000000L / fps};
+	time_t started = time(NULL);
+	while (is_running() && (duration == 0 || time(NULL) - started < duration)) {
+		for (int i=0; i<game_count; i++) {
+			char label[32];
+			pthread_mutex_lock(&games[i].lock);
+			snprintf(label, sizeof(label), "#%i game %i", i, games[i].games + 1);
+			term_renderer_draw_board(tr, i, games[i].board, label);
+			pthread_mutex_unlock(&games[i].lock);
+		}
+		term_renderer_flush(tr, stdout);
+		nanosleep(&frame, NULL);
+	}
+	__atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+	printf("\x1b[%i;1H\x1b[?25h\n", tr->rows + 1);
+
+	for (int i=0; i<thread_count; i++) {
+		pthread_join(sims[i].thread, NULL);
+	}
+	for (int i=0; i<game_count; i++) {
+		board_free(games[i].board);
+		pthread_mutex_destroy(&games[i].lock);
+	}
+	term_renderer_free(tr);
+	free(sims);
+	free(games);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,373 @@
+
+#include <config.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "movegen.h"
+
+/** A piece that lives on the stack, so checking positions never allocates. */
+typedef struct {
+	Point center;
+	Point points[4];
+	Point * blocks[4];
+	Piece piece;
+} StackPiece ;
+
+static void stack_piece_init(StackPiece * s, Piece * p)
+{
+	s->center = *p->center;
+	for (int i=0; i<4; i++) {
+		s->points[i] = *p->blocks[i];
+		s->blocks[i] = &s->points[i];
+	}
+	s->piece.center = &s->center;
+	s->piece.blocks = s->blocks;
+	s->piece.type = p->type;
+}
+
+static bool is_valid_at(Board * b, StackPiece * s, int x, int y)
+{
+	s->center.x = x;
+	s->center.y = y;
+	return board_check_valid_placement(b, &s->piece);
+}
+
+static bool in_search_area(int x, int y)
+{
+	return x >= -MOVEGEN_MARGIN && x < WIDTH + MOVEGEN_MARGIN &&
+		y >= -MOVEGEN_MARGIN && y < HEIGHT + MOVEGEN_MARGIN;
+}
+
+/* Column x is bit x + MASK_OFFSET of a row mask, so blocks left of the search area stay above bit 0. */
+#define MASK_OFFSET (2 * MOVEGEN_MARGIN)
+
+/** The cells of row y a block can't be in, including the walls and the floor. */
+static uint64_t blocked_mask(Board * b, int y)
+{
+	if (y < 0 || y >= b->height) {
+		return ~0ULL;
+	}
+	uint64_t inside = (uint64_t) ((1u << b->width) - 1) << MASK_OFFSET;
+	return ~inside | (uint64_t) board_row_mask(b, y) << MASK_OFFSET;
+}
+
+/** What a search for placements knows about a piece on a board. */
+typedef struct {
+	StackPiece rotations[4];
+	/*
+	 * Bit x + MASK_OFFSET of fits[r][y + MOVEGEN_MARGIN] is set if the piece
+	 * fits with rotation r and its center at (x, y); the same test as
+	 * board_check_valid_placement, for a whole row of centers at once. Only
+	 * rows from the start down are filled in, since pieces never move up.
+	 */
+	uint64_t fits[4][MOVEGEN_SPAN_Y + 1];
+	/* The placements found so far, and the cells each covers. */
+	Placement * out;
+	unsigned long long keys[MOVEGEN_MAX_PLACEMENTS];
+	int found;
+} Search ;
+
+/** Set up p's four rotations, and an empty list of placements in out. */
+static void search_init_pieces(Search * s, Piece * p, Placement * out)
+{
+	stack_piece_init(&s->rotations[0], p);
+	for (int r=1; r<4; r++) {
+		s->rotations[r] = s->rotations[r-1];
+		s->rotations[r].piece.center = &s->rotations[r].center;
+		for (int i=0; i<4; i++) {
+			s->rotations[r].blocks[i] = &s->rotations[r].points[i];
+		}
+		s->rotations[r].piece.blocks = s->rotations[r].blocks;
+		piece_rotate_clockwise(&s->rotations[r].piece);
+	}
+	s->out = out;
+	s->found = 0;
+}
+
+/** Set up a search from p's position. Returns false if the piece doesn't fit there. */
+static bool search_init(Search * s, Board * b, Piece * p, Placement * out)
+{
+	search_init_pieces(s, p, out);
+	int start_x = p->center->x;
+	int start_y = p->center->y;
+	if (!in_search_area(start_x, start_y)) {
+		return false;
+	}
+	// Row y of blocked is at y + 2 * MOVEGEN_MARGIN.
+	uint64_t blocked[MOVEGEN_SPAN_Y + 2 * MOVEGEN_MARGIN + 1];
+	for (int y=start_y - MOVEGEN_MARGIN; y<=HEIGHT + 2 * MOVEGEN_MARGIN; y++) {
+		blocked[y + 2 * MOVEGEN_MARGIN] = blocked_mask(b, y);
+	}
+	uint64_t area = ((1ULL << MOVEGEN_SPAN_X) - 1) << (MASK_OFFSET - MOVEGEN_MARGIN);
+	for (int r=0; r<4; r++) {
+		for (int y=start_y; y<=HEIGHT + MOVEGEN_MARGIN; y++) {
+			uint64_t collides = 0;
+			for (int i=0; i<4; i++) {
+				Point * block = &s->rotations[r].points[i];
+				uint64_t row = blocked[y + block->y + 2 * MOVEGEN_MARGIN];
+				collides |= block->x >= 0 ? row >> block->x : row << -block->x;
+			}
+			s->fits[r][y + MOVEGEN_MARGIN] = ~collides & area;
+		}
+	}
+	return s->fits[0][start_y + MOVEGEN_MARGIN] >> (start_x + MASK_OFFSET) & 1;
+}
+
+static bool fits_at(Search * s, int x, int y, int rotation)
+{
+	return s->fits[rotation][y + MOVEGEN_MARGIN] >> (x + MASK_OFFSET) & 1;
+}
+
+/** 
+ * The cells of a piece relative to the top left of the box around it, 4
+ * bits a row, so rotations that look the same have the same mask.
+ */
+static unsigned int shape_mask(StackPiece * piece, int * left, int * top)
+{
+	*left = piece->points[0].x;
+	*top = piece->points[0].y;
+	for (int i=1; i<4; i++) {
+		*left = piece->points[i].x < *left ? piece->points[i].x : *left;
+		*top = piece->points[i].y < *top ? piece->points[i].y : *top;
+	}
+	unsigned int mask = 0;
+	for (int i=0; i<4; i++) {
+		mask |= 1u << ((piece->points[i].y - *top) * 4 + piece->points[i].x - *left);
+	}
+	return mask;
+}
+
+/** Record a position the piece locks in, unless one covering the same cells already was. */
+static void search_add(Search * s, int x, int y, int rotation)
+{
+	StackPiece * piece = &s->rotations[rotation];
+	int top = piece->points[0].y;
+	for (int i=1; i<4; i++) {
+		top = piece->points[i].y < top ? piece->points[i].y : top;
+	}
+	// The top row, then a mask of each row from there down. Rows are at most WIDTH bits wide.
+	unsigned long long key = (unsigned long long) (y + top) << 48;
+	for (int i=0; i<4; i++) {
+		key |= 1ULL << ((piece->points[i].y - top) * 12 + piece->points[i].x + x);
+	}
+	for (int i=0; i<s->found; i++) {
+		if (s->keys[i] == key) {
+			return;
+		}
+	}
+	s->keys[s->found] = key;
+	s->out[s->found++] = (Placement) {x, y, rotation};
+}
+
+/**
+ * Find every distinct position the piece can lock in, starting from its
+ * current position and orientation. Positions that cover the same cells
+ * are only reported once. out must have room for MOVEGEN_MAX_PLACEMENTS.
+ * Returns the number of placements found; 0 if the piece can't spawn.
+ */
+int movegen_find_placements(Board * b, Piece * p, Placement * out)
+{
+	Search s;
+	if (!search_init(&s, b, p, out)) {
+		return 0;
+	}
+
+	// fits is clear outside the search area, so it doubles as the bounds check.
+	uint64_t visited[4][MOVEGEN_SPAN_Y + 1] = {{0}};
+	Placement queue[MOVEGEN_MAX_PLACEMENTS];
+	int head = 0;
+	int tail = 0;
+
+	queue[tail++] = (Placement) {p->center->x, p->center->y, 0};
+	visited[0][p->center->y + MOVEGEN_MARGIN] |= 1ULL << (p->center->x + MASK_OFFSET);
+	while (head < tail) {
+		Placement current = queue[head++];
+
+		Placement next[5] = {
+			{current.x - 1, current.y, current.rotation},
+			{current.x + 1, current.y, current.rotation},
+			{current.x, current.y + 1, current.rotation},
+			{current.x, current.y, (current.rotation + 1) % 4},
+			{current.x, current.y, (current.rotation + 3) % 4}
+		};
+		for (int i=0; i<5; i++) {
+			Placement n = next[i];
+			uint64_t bit = 1ULL << (n.x + MASK_OFFSET);
+			uint64_t * seen = &visited[n.rotation][n.y + MOVEGEN_MARGIN];
+			if (!(*seen & bit) && fits_at(&s, n.x, n.y, n.rotation)) {
+				*seen |= bit;
+				queue[tail++] = n;
+			}
+		}
+
+		// A position where the piece can't move down is where it locks.
+		if (!fits_at(&s, current.x, current.y + 1, current.rotation)) {
+			search_add(&s, current.x, current.y, current.rotation);
+		}
+	}
+	return s.found;
+}
+
+/**
+ * The same placements as movegen_find_placements, in the same order, found
+ * by testing every position with board_check_valid_placement instead of
+ * the row masks. Much slower; it is the plain definition of a legal move,
+ * to check the fast versions against and to benchmark the board itself.
+ */
+int movegen_find_placements_checked(Board * b, Piece * p, Placement * out)
+{
+	Search s;
+	search_init_pieces(&s, p, out);
+	int start_x = p->center->x;
+	int start_y = p->center->y;
+	if (!in_search_area(start_x, start_y) || !is_valid_at(b, &s.rotations[0], start_x, start_y)) {
+		return 0;
+	}
+
+	bool visited[4][MOVEGEN_SPAN_Y][MOVEGEN_SPAN_X] = {{{false}}};
+	Placement queue[MOVEGEN_MAX_PLACEMENTS];
+	int head = 0;
+	int tail = 0;
+
+	queue[tail++] = (Placement) {start_x, start_y, 0};
+	visited[0][start_y + MOVEGEN_MARGIN][start_x + MOVEGEN_MARGIN] = true;
+	while (head < tail) {
+		Placement current = queue[head++];
+
+		Placement next[5] = {
+			{current.x - 1, current.y, current.rotation},
+			{current.x + 1, current.y, current.rotation},
+			{current.x, current.y + 1, current.rotation},
+			{current.x, current.y, (current.rotation + 1) % 4},
+			{current.x, current.y, (current.rotation + 3) % 4}
+		};
+		for (int i=0; i<5; i++) {
+			Placement n = next[i];
+			if (!in_search_area(n.x, n.y)) {
+				continue;
+			}
+			bool * seen = &visited[n.rotation][n.y + MOVEGEN_MARGIN][n.x + MOVEGEN_MARGIN];
+			if (!*seen && is_valid_at(b, &s.rotations[n.rotation], n.x, n.y)) {
+				*seen = true;
+				queue[tail++] = n;
+			}
+		}
+
+		// A position where the piece can't move down is where it locks.
+		if (!is_valid_at(b, &s.rotations[current.rotation], current.x, current.y + 1)) {
+			search_add(&s, current.x, current.y, current.rotation);
+		}
+	}
+	return s.found;
+}
+
+/**
+ * The same placements as movegen_find_placements, in no particular order.
+ * Instead of a breadth first search, every center the piece can reach in
+ * a row is worked out at once with bit operations, a row at a time from
+ * the top. For callers that try every placement anyway.
+ */
+int movegen_find_placements_unordered(Board * b, Piece * p, Placement * out)
+{
+	Search s;
+	if (!search_init(&s, b, p, out)) {
+		return 0;
+	}
+
+	int start_y = p->center->y;
+	uint64_t reached[4][MOVEGEN_SPAN_Y + 1] = {{0}};
+	reached[0][start_y + MOVEGEN_MARGIN] = 1ULL << (p->center->x + MASK_OFFSET);
+	for (int y=start_y; y<HEIGHT + MOVEGEN_MARGIN; y++) {
+		// Whatever moves down from the row above, then sideways moves and
+		// rotations until they turn up nothing new.
+		if (y > start_y) {
+			for (int r=0; r<4; r++) {
+				reached[r][y + MOVEGEN_MARGIN] = reached[r][y - 1 + MOVEGEN_MARGIN] & s.fits[r][y + MOVEGEN_MARGIN];
+			}
+		}
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (int r=0; r<4; r++) {
+				uint64_t fits = s.fits[r][y + MOVEGEN_MARGIN];
+				uint64_t now = reached[r][y + MOVEGEN_MARGIN];
+				now |= (reached[(r + 1) % 4][y + MOVEGEN_MARGIN] | reached[(r + 3) % 4][y + MOVEGEN_MARGIN]) & fits;
+				for (uint64_t last = 0; last != now; ) {
+					last = now;
+					now |= (now << 1 | now >> 1) & fits;
+				}
+				changed = changed || now != reached[r][y + MOVEGEN_MARGIN];
+				reached[r][y + MOVEGEN_MARGIN] = now;
+			}
+		}
+	}
+
+	// A lock for one rotation covers the same cells as one for an earlier
+	// rotation of the same shape, moved by the difference in their corners.
+	uint64_t locks[4][MOVEGEN_SPAN_Y + 1] = {{0}};
+	int left[4];
+	int top[4];
+	unsigned int shapes[4];
+	for (int r=0; r<4; r++) {
+		shapes[r] = shape_mask(&s.rotations[r], &left[r], &top[r]);
+		for (int y=start_y; y<HEIGHT + MOVEGEN_MARGIN; y++) {
+			uint64_t here = reached[r][y + MOVEGEN_MARGIN] & ~s.fits[r][y + 1 + MOVEGEN_MARGIN];
+			for (int same=0; same<r; same++) {
+				int same_y = y + top[r] - top[same];
+				if (shapes[same] == shapes[r] && same_y >= start_y && same_y < HEIGHT + MOVEGEN_MARGIN) {
+					uint64_t found = locks[same][same_y + MOVEGEN_MARGIN];
+					int shift = left[r] - left[same];
+					here &= ~(shift >= 0 ? found >> shift : found << -shift);
+				}
+			}
+			locks[r][y + MOVEGEN_MARGIN] = here;
+			while (here != 0) {
+				out[s.found++] = (Placement) {__builtin_ctzll(here) - MASK_OFFSET, y, r};
+				here &= here - 1;
+			}
+		}
+	}
+	return s.found;
+}
+
+/** Move a piece, still in its original orientation, to the placement. */
+void movegen_apply(Piece * p, Placement * placement)
+{
+	for (int r=0; r<placement->rotation; r++) {
+		piece_rotate_clockwise(p);
+	}
+	p->center->x = placement->x;
+	p->center->y = placement->y;
+}
+
+/**
+ * Find where p lands when rotated in place, slid sideways to column x and
+ * dropped straight down, the way a hard drop works. Returns false if
+ * something blocks the way.
+ */
+bool movegen_drop(Board * b, Piece * p, int rotation, int x, Placement * out)
+{
+	StackPiece s;
+	stack_piece_init(&s, p);
+	int current_x = p->center->x;
+	int y = p->center->y;
+	if (!is_valid_at(b, &s, current_x, y)) {
+		return false;
+	}
+	for (int r=0; r<rotation; r++) {
+		piece_rotate_clockwise(&s.piece);
+		if (!is_valid_at(b, &s, current_x, y)) {
+			return false;
+		}
+	}
+	while (current_x != x) {
+		current_x += current_x < x ? 1 : -1;
+		if (!is_valid_at(b, &s, current_x, y)) {
+			return false;
+		}
+	}
+	while (is_valid_at(b, &s, current_x, y + 1)) {
+		y++;
+	}
+	*out = (Placement) {current_x, y, rotation};
+	return true;
+}
@@ -0,0 +1,30 @@
+/**
+ * Move generation: every position a piece can be brought to and locked
+ * in, using the same moves a player has (left, right, down and rotation).
+ */
+
+#include "pieces.h"
+
+#ifndef MOVEGEN_H
+#define MOVEGEN_H
+
+/* Centers are searched this far outside the board, since blocks are offset from them. */
+#define MOVEGEN_MARGIN 2
+#define MOVEGEN_SPAN_X (WIDTH + 2 * MOVEGEN_MARGIN)
+#define MOVEGEN_SPAN_Y (HEIGHT + 2 * MOVEGEN_MARGIN)
+#define MOVEGEN_MAX_PLACEMENTS (4 * MOVEGEN_SPAN_X * MOVEGEN_SPAN_Y)
+
+/** Where a piece ends up: its center and how often it was rotated clockwise. */
+typedef struct {
+	int x;
+	int y;
+	int rotation;
+} Placement ;
+
+int movegen_find_placements(Board * b, Piece * p, Placement * out);
+int movegen_find_placements_unordered(Board * b, Piece * p, Placement * out);
+int movegen_find_placements_checked(Board * b, Piece * p, Placement * out);
+void movegen_apply(Piece * p, Placement * placement);
+bool movegen_drop(Board * b, Piece * p, int rotation, int x, Placement * out);
+
+#endif /* MOVEGEN_H */
@@ -0,0 +1,162 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "obs_ring.h"
+
+static size_t obs_ring_size(uint32_t slot_count)
+{
+	return sizeof(ObsRingHeader) + sizeof(ObsSlot) * slot_count;
+}
+
+/** Map size bytes of the shared memory object behind fd. */
+static ObsRing * obs_ring_map(int fd, size_t size, int protection)
+{
+	void * address = mmap(NULL, size, protection, MAP_SHARED, fd, 0);
+	close(fd);
+	if (address == MAP_FAILED) {
+		return NULL;
+	}
+	ObsRing * ring = malloc(sizeof(ObsRing));
+	ring->header = address;
+	ring->size = size;
+	return ring;
+}
+
+/** 
+ * Create (or replace) the ring called name, with room for slot_count
+ * frames. Returns NULL if the shared memory can't be set up.
+ *
+ * A ring being replaced is unlinked rather than truncated, so readers
+ * that still have it mapped keep reading the old frames instead of
+ * faulting; they see the new ring once they open it again.
+ */
+ObsRing * obs_ring_create(const char * name, uint32_t slot_count)
+{
+	if (slot_count == 0) {
+		return NULL;
+	}
+	shm_unlink(name);
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+		return NULL;
+	}
+	size_t size = obs_ring_size(slot_count);
+	if (ftruncate(fd, size) != 0) {
+		close(fd);
+		return NULL;
+	}
+	ObsRing * ring = obs_ring_map(fd, size, PROT_READ | PROT_WRITE);
+	if (ring == NULL) {
+		return NULL;
+	}
+	// ftruncate zero-fills, so every slot starts with sequence 0 (empty).
+	ring->header->slot_count = slot_count;
+	ring->header->head = 0;
+	__atomic_store_n(&ring->header->magic, OBS_RING_MAGIC, __ATOMIC_RELEASE);
+	return ring;
+}
+
+/** Open an existing ring read-only. Returns NULL if it isn't there. */
+ObsRing * obs_ring_open(const char * name)
+{
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		return NULL;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(ObsRingHeader)) {
+		close(fd);
+		return NULL;
+	}
+	ObsRing * ring = obs_ring_map(fd, info.st_size, PROT_READ);
+	if (ring == NULL) {
+		return NULL;
+	}
+	ObsRingHeader * header = ring->header;
+	if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != OBS_RING_MAGIC ||
+		header->slot_count == 0 || obs_ring_size(header->slot_count) > ring->size) {
+		obs_ring_close(ring);
+		return NULL;
+	}
+	return ring;
+}
+
+void obs_ring_close(ObsRing * ring)
+{
+	munmap(ring->header, ring->size);
+	free(ring);
+}
+
+int obs_ring_unlink(const char * name)
+{
+	return shm_unlink(name);
+}
+
+/** 
+ * Publish the board as the next frame. Only one process may publish to a
+ * ring. This never waits for readers; the oldest frame is overwritten.
+ */
+void obs_ring_publish(ObsRing * ring, Board * b)
+{
+	ObsRingHeader * header = ring->header;
+	uint64_t index = header->head;
+	ObsSlot * slot = &header->slots[index % header->slot_count];
+
+	__atomic_store_n(&slot->sequence, 2 * index + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	slot->score = b->score;
+	slot->is_done = b->is_done;
+	env_write_observation(b, slot->cells);
+	__atomic_store_n(&slot->sequence, 2 * (index + 1), __ATOMIC_RELEASE);
+	__atomic_store_n(&header->head, index + 1, __ATOMIC_RELEASE);
+}
+
+/** Number of frames published so far; the newest is head - 1. */
+uint64_t obs_ring_head(ObsRing * ring)
+{
+	return __atomic_load_n(&ring->header->head, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Copy frame index out of the ring. Returns OBS_RING_NOT_READY if it
+ * hasn't been published yet, or OBS_RING_OVERWRITTEN if the reader fell
+ * more than slot_count frames behind and should skip ahead.
+ */
+int obs_ring_read(ObsRing * ring, uint64_t index, ObsFrame * out)
+{
+	ObsRingHeader * header = ring->header;
+	ObsSlot * slot = &header->slots[index % header->slot_count];
+	uint64_t expected = 2 * (index + 1);
+
+	uint64_t before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+	if (before != expected) {
+		return before < expected ? OBS_RING_NOT_READY : OBS_RING_OVERWRITTEN;
+	}
+	out->index = index;
+	out->score = slot->score;
+	out->is_done = slot->is_done;
+	memcpy(out->cells, slot->cells, sizeof(out->cells));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	uint64_t after = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+	return after == expected ? OBS_RING_OK : OBS_RING_OVERWRITTEN;
+}
+
+/** Copy the newest complete frame, for readers that only want the latest state. */
+int obs_ring_read_latest(ObsRing * ring, ObsFrame * out)
+{
+	for (;;) {
+		uint64_t head = obs_ring_head(ring);
+		if (head == 0) {
+			return OBS_RING_NOT_READY;
+		}
+		if (obs_ring_read(ring, head - 1, out) == OBS_RING_OK) {
+			return OBS_RING_OK;
+		}
+	}
+}
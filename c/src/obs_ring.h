@@ -0,0 +1,65 @@
+/**
+ * A ring of board observations in POSIX shared memory.
+ *
+ * One simulator process publishes frames; any number of processes on the
+ * same host can read them. Every slot carries a sequence counter that is
+ * odd while the slot is being written, so readers detect torn or
+ * overwritten frames themselves and the publisher never waits on them.
+ */
+
+#include <stdint.h>
+#include "pieces.h"
+#include "env.h"
+
+#ifndef OBS_RING_H
+#define OBS_RING_H
+
+#define OBS_RING_MAGIC 0x54524E47u
+
+/** Results of obs_ring_read. */
+#define OBS_RING_OK 0
+#define OBS_RING_NOT_READY 1
+#define OBS_RING_OVERWRITTEN 2
+
+/** One published board, as stored in shared memory. */
+typedef struct {
+	/* 2 * (index + 1) once frame index is complete, odd while writing. */
+	uint64_t sequence;
+	int32_t score;
+	uint8_t is_done;
+	/* Same layout as env_write_observation. */
+	uint8_t cells[ENV_OBSERVATION_SIZE];
+} ObsSlot ;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t slot_count;
+	/* Number of frames published so far. */
+	uint64_t head;
+	ObsSlot slots[];
+} ObsRingHeader ;
+
+/** A frame copied out of the ring by a reader. */
+typedef struct {
+	uint64_t index;
+	int32_t score;
+	bool is_done;
+	uint8_t cells[ENV_OBSERVATION_SIZE];
+} ObsFrame ;
+
+/** A process' view of a mapped ring. */
+typedef struct {
+	ObsRingHeader * header;
+	size_t size;
+} ObsRing ;
+
+ObsRing * obs_ring_create(const char * name, uint32_t slot_count);
+ObsRing * obs_ring_open(const char * name);
+void obs_ring_close(ObsRing * ring);
+int obs_ring_unlink(const char * name);
+void obs_ring_publish(ObsRing * ring, Board * b);
+uint64_t obs_ring_head(ObsRing * ring);
+int obs_ring_read(ObsRing * ring, uint64_t index, ObsFrame * out);
+int obs_ring_read_latest(ObsRing * ring, ObsFrame * out);
+
+#endif /* OBS_RING_H */
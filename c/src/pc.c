@@ -0,0 +1,76 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "pieces.h"
+#include "solver.h"
+#include "cli.h"
+
+/**
+ * tetris-pc: find a perfect clear for a starting board and a known
+ * sequence of pieces, and print where each piece goes.
+ *
+ * Ten pieces take about half a second on one core with the default -O2
+ * build, for example LJSZIOLJSZ, which has no clear. Built without
+ * optimization the same search takes over a second.
+ */
+
+static void usage()
+{
+	fprintf(stderr, "usage: tetris-pc [-t threads] [-b board_file] pieces\n"
+			"  pieces   piece sequence, at most %i, from: %s\n"
+			"  -b file  starting board, in board_print format\n", SOLVER_MAX_PIECES, PIECE_LETTERS);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	int thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+	const char * board_file = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "t:b:")) != -1) {
+		if (opt == 't') {
+			thread_count = atoi(optarg);
+		} else if (opt == 'b') {
+			board_file = optarg;
+		} else {
+			usage();
+		}
+	}
+	if (argc - optind != 1 || thread_count < 1) {
+		usage();
+	}
+	const char * pieces = argv[optind];
+	int sequence[SOLVER_MAX_PIECES];
+	int length = cli_parse_pieces(pieces, sequence, SOLVER_MAX_PIECES);
+	if (length < 0) {
+		usage();
+	}
+
+	Board * start = cli_start_board(board_file);
+	if (start == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	struct timespec started;
+	cli_start_timer(&started);
+	SolverSolution solution;
+	bool found = solver_find_perfect_clear(start, sequence, length, thread_count, &solution);
+	double elapsed = cli_seconds_since(&started);
+
+	if (found) {
+		for (int i=0; i<solution.count; i++) {
+			Placement * p = &solution.placements[i];
+			printf("%2i  %c  x %2i  y %2i  rotation %i\n", i + 1, pieces[i], p->x, p->y, p->rotation);
+		}
+		printf("perfect clear in %i rows with %i pieces, %.3fs (%i threads)\n",
+			   solution.height, solution.count, elapsed, thread_count);
+	} else {
+		printf("no perfect clear, %.3fs (%i threads)\n", elapsed, thread_count);
+	}
+	board_free(start);
+	return found ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,337 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "pieces.h"
+#include "movegen.h"
+#include "counters.h"
+#include "cli.h"
+
+/**
+ * tetris-perft: count the board states reachable by placing a known
+ * sequence of pieces, depth by depth.
+ *
+ * The counts only depend on move generation and line clearing, so they
+ * make a repeatable correctness check and benchmark for the engine. By
+ * default moves come from the row mask move generator, which never calls
+ * board_check_valid_placement; -c finds them by testing each position
+ * with it instead, to benchmark the board itself. Both give the same
+ * counts.
+ */
+
+#define MAX_DEPTH 32
+#define STRIPES 64
+
+/** A board reduced to which cells are filled. */
+typedef struct {
+	uint16_t rows[HEIGHT];
+	int depth;
+} StateKey ;
+
+typedef struct {
+	pthread_mutex_t lock;
+	StateKey * keys;
+	uint64_t * hashes;
+	size_t size;
+	size_t capacity;
+} Stripe ;
+
+/** States seen so far at each depth, shared by all threads. */
+typedef struct {
+	Stripe stripes[STRIPES];
+} StateSet ;
+
+typedef struct {
+	int sequence[MAX_DEPTH];
+	int sequence_length;
+	int depth;
+	bool dedup;
+	/* Find moves with movegen_find_placements_checked. */
+	bool checked;
+	StateSet seen;
+
+	Board * roots;
+	int root_count;
+	int next_root;
+	pthread_mutex_t roots_lock;
+} Perft ;
+
+/** One depth of a worker's search. */
+typedef struct {
+	Board board;
+	Placement placements[MOVEGEN_MAX_PLACEMENTS];
+} Ply ;
+
+/** A search thread, with scratch space allocated once so searching never allocates. */
+typedef struct {
+	Perft * perft;
+	unsigned long long counts[MAX_DEPTH + 1];
+	Ply * plies;
+	/* Every type of piece at its spawn rotation, and turned each way to be locked. */
+	Piece * spawns[PIECE_TYPE_COUNT];
+	Piece * rotated[PIECE_TYPE_COUNT][4];
+	pthread_t thread;
+} Worker ;
+
+static void state_key(Board * b, int depth, StateKey * key)
+{
+	memset(key, 0, sizeof(StateKey));
+	for (int y=0; y<b->height; y++) {
+		key->rows[y] = board_row_mask(b, y);
+	}
+	key->depth = depth;
+}
+
+static uint64_t state_hash(StateKey * key)
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	const unsigned char * bytes = (const unsigned char *) key;
+	for (size_t i=0; i<sizeof(StateKey); i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash | 1; // 0 marks an empty slot
+}
+
+static void stripe_grow(Stripe * s)
+{
+	size_t old_capacity = s->capacity;
+	StateKey * old_keys = s->keys;
+	uint64_t * old_hashes = s->hashes;
+	s->capacity = old_capacity == 0 ? 1024 : old_capacity * 2;
+	s->keys = malloc(sizeof(StateKey) * s->capacity);
+	s->hashes = calloc(s->capacity, sizeof(uint64_t));
+	for (size_t i=0; i<old_capacity; i++) {
+		if (old_hashes[i] != 0) {
+			size_t j = old_hashes[i] & (s->capacity - 1);
+			while (s->hashes[j] != 0) {
+				j = (j + 1) & (s->capacity - 1);
+			}
+			s->hashes[j] = old_hashes[i];
+			s->keys[j] = old_keys[i];
+		}
+	}
+	free(old_keys);
+	free(old_hashes);
+}
+
+/** Add the board to the set. Returns false if it was already there. */
+static bool state_set_insert(StateSet * set, Board * b, int depth)
+{
+	StateKey key;
+	state_key(b, depth, &key);
+	uint64_t hash = state_hash(&key);
+	Stripe * s = &set->stripes[(hash >> 58) % STRIPES];
+
+	pthread_mutex_lock(&s->lock);
+	if ((s->size + 1) * 10 > s->capacity * 7) {
+		stripe_grow(s);
+	}
+	size_t i = hash & (s->capacity - 1);
+	bool inserted = true;
+	while (s->hashes[i] != 0) {
+		if (s->hashes[i] == hash && memcmp(&s->keys[i], &key, sizeof(StateKey)) == 0) {
+			inserted = false;
+			break;
+		}
+		i = (i + 1) & (s->capacity - 1);
+	}
+	if (inserted) {
+		s->hashes[i] = hash;
+		s->keys[i] = key;
+		s->size++;
+	}
+	pthread_mutex_unlock(&s->lock);
+	return inserted;
+}
+
+static void worker_init(Worker * w, Perft * perft)
+{
+	w->perft = perft;
+	w->plies = malloc(sizeof(Ply) * (MAX_DEPTH + 1));
+	for (int i=0; i<PIECE_TYPE_COUNT; i++) {
+		w->spawns[i] = piece_create_type(i, WIDTH / 2, 2);
+		for (int r=0; r<4; r++) {
+			w->rotated[i][r] = piece_create_type(i, 0, 0);
+			movegen_apply(w->rotated[i][r], &(Placement) {0, 0, r});
+		}
+	}
+}
+
+static void worker_free(Worker * w)
+{
+	for (int i=0; i<PIECE_TYPE_COUNT; i++) {
+		piece_free(w->spawns[i]);
+		for (int r=0; r<4; r++) {
+			piece_free(w->rotated[i][r]);
+		}
+	}
+	free(w->plies);
+}
+
+/** Where the piece due at depth can be placed on b. Returns the number of placements. */
+static int expand(Worker * w, Board * b, int depth, Placement * placements)
+{
+	Perft * perft = w->perft;
+	Piece * p = w->spawns[perft->sequence[depth % perft->sequence_length]];
+	if (perft->checked) {
+		return movegen_find_placements_checked(b, p, placements);
+	}
+	return movegen_find_placements(b, p, placements);
+}
+
+/** 
+ * Lock the piece due at depth into a copy of b at child. Returns false if
+ * the state was already counted.
+ */
+static bool make_child(Worker * w, Board * b, int depth, Placement * placement, Board * child)
+{
+	Perft * perft = w->perft;
+	Piece * p = w->rotated[perft->sequence[depth % perft->sequence_length]][placement->rotation];
+	p->center->x = placement->x;
+	p->center->y = placement->y;
+	*child = *b;
+	board_lock_piece(child, p);
+	return !perft->dedup || state_set_insert(&perft->seen, child, depth + 1);
+}
+
+static void perft_search(Worker * w, Board * b, int depth)
+{
+	Perft * perft = w->perft;
+	w->counts[depth]++;
+	if (depth == perft->depth) {
+		return;
+	}
+	Placement * placements = w->plies[depth].placements;
+	Board * child = &w->plies[depth + 1].board;
+	int count = expand(w, b, depth, placements);
+	for (int i=0; i<count; i++) {
+		if (make_child(w, b, depth, &placements[i], child)) {
+			perft_search(w, child, depth + 1);
+		}
+	}
+}
+
+/** Worker threads take subtrees under the first piece one at a time. */
+static void * worker_run(void * arg)
+{
+	Worker * worker = arg;
+	Perft * perft = worker->perft;
+	for (;;) {
+		pthread_mutex_lock(&perft->roots_lock);
+		int i = perft->next_root++;
+		pthread_mutex_unlock(&perft->roots_lock);
+		if (i >= perft->root_count) {
+			return NULL;
+		}
+		perft_search(worker, &perft->roots[i], 1);
+	}
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: tetris-perft [-t threads] [-d] [-c] [-b board_file] pieces depth\n"
+			"  pieces   piece sequence, repeated as needed, from: %s\n"
+			"  -d       count distinct states only, pruning repeated ones\n"
+			"  -c       find moves with board_check_valid_placement, not row masks\n"
+			"  -b file  starting board, in board_print format\n", PIECE_LETTERS);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	Perft perft;
+	memset(&perft, 0, sizeof(Perft));
+	int thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+	const char * board_file = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "t:dcb:")) != -1) {
+		if (opt == 't') {
+			thread_count = atoi(optarg);
+		} else if (opt == 'd') {
+			perft.dedup = true;
+		} else if (opt == 'c') {
+			perft.checked = true;
+		} else if (opt == 'b') {
+			board_file = optarg;
+		} else {
+			usage();
+		}
+	}
+	if (argc - optind != 2 || thread_count < 1) {
+		usage();
+	}
+	const char * pieces = argv[optind];
+	perft.depth = atoi(argv[optind + 1]);
+	perft.sequence_length = cli_parse_pieces(pieces, perft.sequence, MAX_DEPTH);
+	if (perft.depth < 1 || perft.depth > MAX_DEPTH || perft.sequence_length < 0) {
+		usage();
+	}
+
+	Board * start = cli_start_board(board_file);
+	if (start == NULL) {
+		return EXIT_FAILURE;
+	}
+	for (int i=0; i<STRIPES; i++) {
+		pthread_mutex_init(&perft.seen.stripes[i].lock, NULL);
+	}
+	pthread_mutex_init(&perft.roots_lock, NULL);
+
+	struct timespec started;
+	cli_start_timer(&started);
+
+	Worker * workers = calloc(thread_count, sizeof(Worker));
+	for (int i=0; i<thread_count; i++) {
+		worker_init(&workers[i], &perft);
+	}
+	// The first piece is placed here, and the boards it leaves are handed out to the threads.
+	Placement * placements = workers[0].plies[0].placements;
+	int count = expand(&workers[0], start, 0, placements);
+	perft.roots = malloc(sizeof(Board) * MOVEGEN_MAX_PLACEMENTS);
+	for (int i=0; i<count; i++) {
+		if (make_child(&workers[0], start, 0, &placements[i], &perft.roots[perft.root_count])) {
+			perft.root_count++;
+		}
+	}
+	for (int i=0; i<thread_count; i++) {
+		pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]);
+	}
+
+	unsigned long long counts[MAX_DEPTH + 1] = {1};
+	for (int i=0; i<thread_count; i++) {
+		pthread_join(workers[i].thread, NULL);
+		for (int d=1; d<=perft.depth; d++) {
+			counts[d] += workers[i].counts[d];
+		}
+	}
+	double elapsed = cli_seconds_since(&started);
+
+	unsigned long long total = 0;
+	for (int d=1; d<=perft.depth; d++) {
+		printf("depth %2i  %c  %llu\n", d, pieces[(d - 1) % perft.sequence_length], counts[d]);
+		total += counts[d];
+	}
+	printf("%llu %s in %.3fs (%.0f per second, %i threads, %s)\n", total,
+		   perft.dedup ? "distinct states" : "nodes", elapsed, total / elapsed, thread_count,
+		   perft.checked ? "checked moves" : "row mask moves");
+	counters_print(stdout);
+
+	for (int i=0; i<thread_count; i++) {
+		worker_free(&workers[i]);
+	}
+	free(perft.roots);
+	for (int i=0; i<STRIPES; i++) {
+		free(perft.seen.stripes[i].keys);
+		free(perft.seen.stripes[i].hashes);
+	}
+	free(workers);
+	board_free(start);
+	return EXIT_SUCCESS;
+}
@@ -2,9 +2,13 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include "pieces.h"
+#include "counters.h"
 
-const char * COLORS[5] = {"#BB0000", "blue", "#2dd400", "#ff950c", "#2ea4ff"};
+const char * PALETTE[PALETTE_SIZE] = {
+	NULL, "blue", "#BB0000", "#2dd400", "#ff950c", "#2ea4ff", "#4b0063", "#808080"
+};
 
 /** Point functions */
 bool point_equals(Point *p1, Point *p2)
@@ -20,6 +24,7 @@ void point_print(Point *p){
 Point * point_create (int x, int y)
 {
 	Point *p = malloc (sizeof (Point));
+	COUNT(COUNTER_ALLOCATIONS);
 	p->x = x;
 	p->y = y;
 	return p;
@@ -28,9 +33,9 @@ Point * point_create (int x, int y)
 Point * point_copy (Point * old_point)
 {
 	Point *p = malloc (sizeof (Point));
+	COUNT(COUNTER_ALLOCATIONS);
 	p->x = old_point->x;
 	p->y = old_point->y;
-	p->color = old_point->color;
 	return p;
 };
 
@@ -44,6 +49,16 @@ void point_free (Point * p)
 
 /** Piece functions */
 
+/* The block offsets of each PieceType before it is rotated, indexed by PieceType. */
+static int PIECE_SHAPES[PIECE_TYPE_COUNT][4][2] = {
+	{{0,-1}, {0,0}, {0,1}, {0,2}},
+	{{0,0}, {1,0}, {1,1}, {0,1}},
+	{{-1,0}, {0,0}, {1,0}, {1,1}},
+	{{-1,0}, {0,0}, {1,0}, {1,-1}},
+	{{-1,0}, {0,0}, {0,1}, {1,1}},
+	{{-1,0}, {0,0}, {0,-1}, {1,-1}}
+};
+
 /**
  * Line shape
  *   #
@@ -53,8 +68,9 @@ void point_free (Point * p)
  */
 Piece * line(int x, int y)
 {
-	int blocks[4][2] = {{0,-1}, {0,0}, {0,1}, {0,2}};
-	return piece_create(x, y, blocks, "blue");
+	Piece * p = piece_create(x, y, PIECE_SHAPES[PIECE_LINE], PIECE_LINE + 1);
+	p->type = PIECE_LINE;
+	return p;
 };
 
 /**
@@ -64,9 +80,9 @@ Piece * line(int x, int y)
  */
 Piece * square(int x, int y)
 {
-	int blocks[4][2] = {{0,0}, {1,0}, {1,1}, {0,1}};
-	return piece_create(x, y, blocks, 
-"#BB0000");
+	Piece * p = piece_create(x, y, PIECE_SHAPES[PIECE_SQUARE], PIECE_SQUARE + 1);
+	p->type = PIECE_SQUARE;
+	return p;
 };
 
 /**
@@ -76,8 +92,9 @@ Piece * square(int x, int y)
  */
 Piece * l_shape1(int x, int y)
 {
-	int blocks[4][2] = {{-1,0}, {0,0}, {1,0}, {1,1}};
-	return piece_create(x, y, blocks, "#2dd400");
+	Piece * p = piece_create(x, y, PIECE_SHAPES[PIECE_L_SHAPE1], PIECE_L_SHAPE1 + 1);
+	p->type = PIECE_L_SHAPE1;
+	return p;
 };
 
 /**
@@ -87,8 +104,9 @@ Piece * l_shape1(int x, int y)
  */
 Piece * l_shape2(int x, int y)
 {
-	int blocks[4][2] = {{-1,0}, {0,0}, {1,0}, {1,-1}};
-	return piece_create(x, y, blocks, "#ff950c");
+	Piece * p = piece_create(x, y, PIECE_SHAPES[PIECE_L_SHAPE2], PIECE_L_SHAPE2 + 1);
+	p->type = PIECE_L_SHAPE2;
+	return p;
 };
 
 /**
@@ -98,8 +116,9 @@ Piece * l_shape2(int x, int y)
  */
 Piece * n_shape1(int x, int y)
 {
-	int blocks[4][2] = {{-1,0}, {0,0}, {0,1}, {1,1}};
-	return piece_create(x, y, blocks, "#2ea4ff");
+	Piece * p = piece_create(x, y, PIECE_SHAPES[PIECE_N_SHAPE1], PIECE_N_SHAPE1 + 1);
+	p->type = PIECE_N_SHAPE1;
+	return p;
 };
 
 /**
@@ -109,51 +128,143 @@ Piece * n_shape1(int x, int y)
  */
 Piece * n_shape2(int x, int y)
 {
-	int blocks[4][2] = {{-1,0}, {0,0}, {0,-1}, {1,-1}};
-	return piece_create(x, y, blocks, "#4b0063");
+	Piece * p = piece_create(x, y, PIECE_SHAPES[PIECE_N_SHAPE2], PIECE_N_SHAPE2 + 1);
+	p->type = PIECE_N_SHAPE2;
+	return p;
+};
+
+/* Indexed by PieceType */
+static Piece * (* const PIECE_CONSTRUCTORS[PIECE_TYPE_COUNT]) (int x, int y) = {
+	line, square, l_shape1, l_shape2, n_shape1, n_shape2
 };
 
+const char PIECE_LETTERS[PIECE_TYPE_COUNT + 1] = "IOLJZS";
+
+/** The PieceType a letter from PIECE_LETTERS stands for, or -1 if it isn't one. */
+int piece_type_from_letter(char letter)
+{
+	const char * found = letter != '\0' ? strchr(PIECE_LETTERS, letter) : NULL;
+	return found != NULL ? found - PIECE_LETTERS : -1;
+}
+
+/** 
+ * Write the block offsets a piece of the given PieceType has after the
+ * given number of clockwise quarter turns, in the order its constructor
+ * creates them.
+ */
+void piece_shape(int type, int rotation, int blocks[4][2])
+{
+	for (int i=0; i<4; i++) {
+		int x = PIECE_SHAPES[type][i][0];
+		int y = PIECE_SHAPES[type][i][1];
+		// The same turn as piece_rotate_clockwise.
+		for (int r=0; r<rotation; r++) {
+			int old_x = x;
+			x = -y;
+			y = old_x;
+		}
+		blocks[i][0] = x;
+		blocks[i][1] = y;
+	}
+}
+
+/** Create a piece of the given PieceType. */
+Piece * piece_create_type(int type, int x, int y)
+{
+	return (*PIECE_CONSTRUCTORS[type])(x, y);
+}
+
+/** 
+ * Turn p into the piece piece_create_type would make, reusing its memory,
+ * so a board can spawn pieces without allocating.
+ */
+void piece_reset_type(Piece * p, int type, int x, int y)
+{
+	for (int i=0; i<4; i++) {
+		p->blocks[i]->x = PIECE_SHAPES[type][i][0];
+		p->blocks[i]->y = PIECE_SHAPES[type][i][1];
+	}
+	p->center->x = x;
+	p->center->y = y;
+	p->type = type;
+	p->rotation = 0;
+	p->color = type + 1;
+}
+
 Piece * piece_create_random(int x, int y)
 {
-	Piece * (* const func[6]) (int x, int y) = {
-		line, square, l_shape1, l_shape2, n_shape1, n_shape1
-	};
-	int i = rand() % 6;
-	Piece * p = (*func[i])(x, y);
+	int i = rand() % PIECE_TYPE_COUNT;
+	Piece * p = (*PIECE_CONSTRUCTORS[i])(x, y);
 	return p;
 }
 
+/** 
+ * Advance a xorshift generator. Unlike rand(), the whole state lives in 
+ * the caller's variable, so every board can own an independent sequence.
+ */
+static unsigned int next_random(unsigned int * state)
+{
+	unsigned int x = *state;
+	if (x == 0) {
+		x = 0x9E3779B9u;
+	}
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+/** Create a random piece, drawing from the given seed instead of rand(). */
+Piece * piece_create_seeded(int x, int y, unsigned int * seed)
+{
+	int i = next_random(seed) % PIECE_TYPE_COUNT;
+	return (*PIECE_CONSTRUCTORS[i])(x, y);
+}
+
 /** Piece constructor */
-Piece * piece_create(int center_x, int center_y, int coords[4][2], char * color)
+Piece * piece_create(int center_x, int center_y, int coords[4][2], int color)
 {
-	Point ** blocks = (Point **) malloc(sizeof(Point)*4);
+	Point ** blocks = (Point **) malloc(sizeof(Point *)*4);
+	COUNT(COUNTER_ALLOCATIONS);
 	for (int i=0; i<4; i++){
-		Point * new_point = point_create(coords[i][0], coords[i][1]);
-		blocks[i] = new_point;
-		new_point->color = color;
+		blocks[i] = point_create(coords[i][0], coords[i][1]);
 	}
 	Point * center = point_create(center_x, center_y);
 	Piece * p = malloc (sizeof(Piece));
+	COUNT(COUNTER_ALLOCATIONS);
 	p->center = center;
 	p->blocks = blocks;
+	p->type = -1;
+	p->rotation = 0;
+	p->color = color;
 	return p;
 };
 
 Piece * piece_copy(Piece * old_piece)
 {
-	Point ** blocks = (Point **) malloc(sizeof(Point)*4);
+	COUNT(COUNTER_PIECE_COPIES);
+	Point ** blocks = (Point **) malloc(sizeof(Point *)*4);
+	COUNT(COUNTER_ALLOCATIONS);
 	for (int i=0; i<4; i++) {
 		blocks[i] = point_copy(old_piece->blocks[i]);
 	}
 	Point * center = point_create(old_piece->center->x, old_piece->center->y);
 	Piece * p = malloc (sizeof(Piece));
+	COUNT(COUNTER_ALLOCATIONS);
 	p->center = center;
 	p->blocks = blocks;
+	p->type = old_piece->type;
+	p->rotation = old_piece->rotation;
+	p->color = old_piece->color;
 	return p;
 }
 
 void piece_free (Piece * p)
 {
+	for (int i=0; i<4; i++) {
+		point_free(p->blocks[i]);
+	}
 	free(p->center);
 	free(p->blocks);
 	free (p);
@@ -166,6 +277,12 @@ void piece_down(Piece* p)
 	p->center->y++;
 };
 
+/* Mutate a piece by moving up 1. Only used to undo piece_down. */
+void piece_up(Piece* p)
+{
+	p->center->y--;
+};
+
 /* Mutate a piece by moving left 1 */
 void piece_left(Piece *p)
 {
@@ -181,23 +298,27 @@ void piece_right(Piece *p)
 /* Mutate a piece by rotating it clockwise around (0,0) */
 void piece_rotate_clockwise(Piece *p)
 {
+	COUNT(COUNTER_ROTATIONS);
 	for (int i=0; i<4; i++) {
 		Point * point = p->blocks[i];
 		int x = point->x;
 		point->x = -(point->y);
 		point->y = x;
 	}
+	p->rotation = (p->rotation + 1) % 4;
 };
 
 /* Mutate a piece by rotating it counter clockwise around (0,0) */
 void piece_rotate_counter_clockwise(Piece *p)
 {
+	COUNT(COUNTER_ROTATIONS);
 	for (int i=0; i<4; i++) {
 		Point * point = p->blocks[i];
 		int x = point->x;
 		point->x = point->y;
 		point->y = -(x);
 	}
+	p->rotation = (p->rotation + 3) % 4;
 };
 
 bool piece_equals(Piece *p1, Piece *p2)
@@ -225,47 +346,126 @@ bool piece_equals(Piece *p1, Piece *p2)
 
 
 /** Board functions */
+
+/** Tell the board's listener, if it has one, that something happened. */
+static void board_notify(Board * b, int kind, Piece * p, unsigned int cleared_rows, int cleared_count)
+{
+	if (b->listener == NULL) {
+		return;
+	}
+	BoardEvent event;
+	event.kind = kind;
+	event.piece = p;
+	event.cleared_rows = cleared_rows;
+	event.cleared_count = cleared_count;
+	event.cause = 0;
+	(*b->listener)(b, &event, b->listener_data);
+}
+
+/** End the game, telling the listener why. */
+void board_top_out(Board * b, int cause)
+{
+	b->is_done = true;
+	if (b->listener != NULL) {
+		BoardEvent event = {BOARD_EVENT_TOP_OUT, b->current_piece, 0, 0, cause};
+		(*b->listener)(b, &event, b->listener_data);
+	}
+}
+
+void board_set_listener(Board * b, void (*listener) (Board *, BoardEvent *, void *), void * data)
+{
+	b->listener = listener;
+	b->listener_data = data;
+}
+
 Board * board_create()
+{
+	return board_create_seeded(rand());
+};
+
+/** Create a board whose piece sequence is fully determined by the seed. */
+Board * board_create_seeded(unsigned int seed)
 {
 	Board *b = malloc (sizeof (Board));
+	COUNT(COUNTER_ALLOCATIONS);
 	b->height = HEIGHT;
 	b->width = WIDTH;
+	b->current_piece = NULL;
+	b->listener = NULL;
+	b->listener_data = NULL;
+	memset(b->cells, 0, sizeof(b->cells));
+	board_reset(b, seed);
+	return b;
+};
+
+/** Create an independent copy of the board, including its random state. */
+Board * board_copy(Board * old_board)
+{
+	Board *b = malloc (sizeof (Board));
+	COUNT(COUNTER_ALLOCATIONS);
+	*b = *old_board;
+	// Copies are for trying things out; whoever listens to the original doesn't want to hear about them.
+	b->listener = NULL;
+	b->listener_data = NULL;
+	b->current_piece = piece_copy(old_board->current_piece);
+	return b;
+};
+
+/** Clear the board and start a new game, reusing the board's memory. */
+void board_reset(Board * b, unsigned int seed)
+{
+	memset(b->cells, 0, sizeof(b->cells));
 	b->score = 0;
+	b->lines = 0;
 	b->is_done = false;
-	//  b->placed_blocks = p;
-	b->current_piece = piece_create_random((b->width / 2), 2);
-	for (int x=0; x<b->width; x++){
-		for (int y=0; y<b->height; y++){
-			b->placed_blocks[x][y] = NULL;
-		}
+	b->rng_state = seed;
+	if (b->current_piece == NULL) {
+		b->current_piece = piece_create_seeded((b->width / 2), 2, &b->rng_state);
+	} else {
+		piece_reset_type(b->current_piece, next_random(&b->rng_state) % PIECE_TYPE_COUNT, (b->width / 2), 2);
 	}
-	return b;
+	board_notify(b, BOARD_EVENT_RESET, b->current_piece, 0, 0);
 };
 
 void board_free (Board * b)
 {
-	free (b->current_piece);
-	free (b->placed_blocks);
+	piece_free (b->current_piece);
 	free (b);
 	return;
 };
 
-/* Get the piece at the given x,y coords */
-Point * board_find_piece_at(Board * b, int x, int y)
+/* Get the PALETTE index of the block at the given x,y coords, 0 if there is none */
+int board_cell(Board * b, int x, int y)
 {
-	return b->placed_blocks[x][y];
+	return (b->cells[y] >> (x * CELL_BITS)) & CELL_MASK;
 };
 
-/** Is the given row complete? */
-bool board_is_row_complete(Board * b, int row)
+/* Fill the cell at the given x,y coords with a PALETTE index, or empty it with 0 */
+void board_set_cell(Board * b, int x, int y, int color)
+{
+	b->cells[y] = (b->cells[y] & ~(CELL_MASK << (x * CELL_BITS))) | ((uint32_t) color << (x * CELL_BITS));
+};
+
+/** The filled cells of row y, one bit per column with column x at bit x. */
+unsigned int board_row_mask(Board * b, int y)
 {
+	uint32_t row = b->cells[y];
+	// Fold each cell's 3 bits into its lowest, at bit x * CELL_BITS, then move that to bit x.
+	uint32_t filled = row | row >> 1 | row >> 2;
+	unsigned int mask = 0;
 	for (int x=0; x<b->width; x++) {
-		Point * found_piece = board_find_piece_at(b, x, row);
-		if (found_piece == NULL) {
-			return false;
-		}
+		mask |= (filled >> (x * (CELL_BITS - 1))) & (1u << x);
 	}
-	return true;
+	return mask;
+};
+
+/** Is the given row complete? */
+bool board_is_row_complete(Board * b, int row)
+{
+	// The lowest bit of each cell, for the columns the board has.
+	uint32_t lows = 01111111111u & ((1u << (b->width * CELL_BITS)) - 1);
+	uint32_t cells = b->cells[row];
+	return ((cells | cells >> 1 | cells >> 2) & lows) == lows;
 };
 
 /** 
@@ -277,6 +477,7 @@ bool board_is_row_complete(Board * b, int row)
 bool * board_find_completed_rows(Board * b)
 {
 	bool * result = malloc(sizeof(bool) * b->height);
+	COUNT(COUNTER_ALLOCATIONS);
 	for (int y=0; y<b->height; y++)	{
 		result[y] = board_is_row_complete(b, y);
 	}
@@ -301,16 +502,16 @@ int count_true(bool * boolean_list, int list_size)
  */
 bool board_check_valid_placement(Board * b, Piece * p)
 {
+	COUNT(COUNTER_VALID_PLACEMENT_CHECKS);
 	for (int i=0; i<4; i++){
 		Point * current_point = p->blocks[i];
 		int absolute_x = current_point->x + p->center->x; 
 		int absolute_y = current_point->y + p->center->y; 
-		if (absolute_x < 0 || absolute_x >= b->width || absolute_y >= b->height) {
+		if (absolute_x < 0 || absolute_x >= b->width || absolute_y < 0 || absolute_y >= b->height) {
 			return false;
 		}
 
-		Point * overlapping_point = board_find_piece_at(b, absolute_x, absolute_y);
-		if (overlapping_point != NULL) {
+		if (board_cell(b, absolute_x, absolute_y) != 0) {
 			return false;
 		}
 	}
@@ -323,13 +524,29 @@ bool board_check_valid_placement(Board * b, Piece * p)
  */  
 bool board_can_piece_move_down(Board * b)
 {
-	Piece * copy = piece_copy(b->current_piece);
-	piece_down(copy);
-	bool result = board_check_valid_placement(b, copy);
-	piece_free(copy);
+	Piece * p = b->current_piece;
+	piece_down(p);
+	bool result = board_check_valid_placement(b, p);
+	piece_up(p);
 	return result;
 }
 
+/** 
+ * Mutate the current piece, but only if the result is valid. 
+ * The inverse mutator is used to undo an invalid move, so no copy of the
+ * piece is needed.
+ */
+bool board_try_move(Board * b, void (*mutator) (Piece *), void (*inverse) (Piece *))
+{
+	Piece * p = b->current_piece;
+	(*mutator)(p);
+	if (board_check_valid_placement(b, p)) {
+		return true;
+	}
+	(*inverse)(p);
+	return false;
+}
+
 /** Add a piece to the board. */
 void board_place_piece(Board * b, Piece * p)
 {
@@ -338,41 +555,64 @@ void board_place_piece(Board * b, Piece * p)
 		Point * point = p->blocks[i];
 		int absolute_x = point->x + p->center->x; 
 		int absolute_y = point->y + p->center->y; 
-		Point * new_point = point_create(absolute_x, absolute_y);
-		new_point->color = point->color;
-		b->placed_blocks[absolute_x][absolute_y] = new_point;
+		board_set_cell(b, absolute_x, absolute_y, p->color);
 	}
 }
 
 /** Remove a row from the board and push the remaining blocks down. */
 void board_remove_row(Board * b, int row)
 {
-	// Remove the row;
-	for (int x=0; x<b->width; x++) {
-		Point * p = b->placed_blocks[x][row];
-		point_free(p);
-		b->placed_blocks[x][row] = NULL;
-	}  
+	// Move the rows above down over it, and open an empty one at the top
+	memmove(b->cells + 1, b->cells, sizeof(uint32_t) * row);
+	b->cells[0] = 0;
+}
 
-	// Move the other blocks down
-	for (int y=row; y>0; y--) {
+/**
+ * Push every block up by rows and fill the rows that open at the bottom,
+ * leaving a gap at hole_column. If blocks are pushed off the top, or the
+ * current piece can't be moved up out of the way, the game is over.
+ * hole_column is clamped to the board, so every garbage row has a hole.
+ * Returns false if the game ended.
+ */
+bool board_add_garbage(Board * b, int rows, int hole_column)
+{
+	if (rows <= 0) {
+		return !b->is_done;
+	}
+	if (rows > b->height) {
+		rows = b->height;
+	}
+	hole_column = hole_column < 0 ? 0 : (hole_column >= b->width ? b->width - 1 : hole_column);
+	bool pushed_out = false;
+	for (int y=0; y<rows; y++) {
+		pushed_out = pushed_out || b->cells[y] != 0;
+	}
+	memmove(b->cells, b->cells + rows, sizeof(uint32_t) * (b->height - rows));
+	for (int y=b->height-rows; y<b->height; y++) {
+		b->cells[y] = 0;
 		for (int x=0; x<b->width; x++) {
-			Point * above = b->placed_blocks[x][y-1];
-			b->placed_blocks[x][y] = above;
-			if (above != NULL){
-				above->y = y;
+			if (x != hole_column) {
+				board_set_cell(b, x, y, PALETTE_SIZE - 1);
 			}
-			b->placed_blocks[x][y-1] = NULL;
 		}
 	}
+
+	Piece * current = b->current_piece;
+	for (int i=0; i<rows && !board_check_valid_placement(b, current); i++) {
+		piece_up(current);
+	}
+	board_notify(b, BOARD_EVENT_GARBAGE, current, 0, rows);
+	if (pushed_out || !board_check_valid_placement(b, current)) {
+		board_top_out(b, TOP_OUT_GARBAGE);
+	}
+	return !b->is_done;
 }
 
 void board_print(Board * b)
 {
 	for (int y=0; y<b->height; y++) {
 		for (int x=0; x<b->width; x++) {	
-			Point * p = b->placed_blocks[x][y];
-			if (p != NULL){
+			if (board_cell(b, x, y) != 0){
 				printf("X ");
 			} else {
 				printf(". ");
@@ -383,6 +623,71 @@ void board_print(Board * b)
 	printf("\n");
 }
 
+/** 
+ * Fill the board from a file in the format board_print writes: one line
+ * per row, X for a filled cell and . for an empty one. Other characters
+ * are ignored. Returns false if the file ended before any row was read.
+ */
+bool board_read(Board * b, FILE * file)
+{
+	char line[256];
+	int y = 0;
+	while (y < b->height && fgets(line, sizeof(line), file) != NULL) {
+		int x = 0;
+		for (char * c = line; *c != '\0' && x < b->width; c++) {
+			if (*c == 'X' || *c == '.') {
+				board_set_cell(b, x, y, *c == 'X' ? PALETTE_SIZE - 1 : 0);
+				x++;
+			}
+		}
+		if (x > 0) {
+			y++;
+		}
+	}
+	return y > 0;
+}
+
+/** 
+ * Add a piece to the board, then remove any rows it completed and score
+ * them. Returns the number of rows removed.
+ */
+int board_lock_piece(Board * b, Piece * p)
+{
+	board_place_piece(b, p);
+	bool completed_rows[HEIGHT];
+	for (int y=0; y<b->height; y++)	{
+		completed_rows[y] = board_is_row_complete(b, y);
+	}
+	int total_complete_rows = count_true(completed_rows, b->height);
+	unsigned int cleared_rows = 0;
+	// Remove from the top down, so each removal doesn't shift rows still to be removed.
+	for (int y=0; y<b->height; y++) {
+		if (completed_rows[y]) {
+			board_remove_row(b, y);
+			cleared_rows |= 1u << y;
+		}
+	}
+
+	// score the points
+	if (total_complete_rows == 1) {
+		b->score += 10;
+	} else if (total_complete_rows == 2) {
+		b->score += 25;
+	} else if (total_complete_rows == 3) {
+		b->score += 40;
+	} else if (total_complete_rows == 4) {
+		b->score += 55;
+	}
+	b->lines += total_complete_rows;
+	COUNT(COUNTER_LOCKS);
+	if (total_complete_rows > 0) {
+		// Boards filled by board_read or garbage can have more than 4 rows complete at once.
+		COUNT(total_complete_rows < 4 ? COUNTER_CLEARS_1 + total_complete_rows - 1 : COUNTER_CLEARS_4);
+	}
+	board_notify(b, BOARD_EVENT_LOCK, p, cleared_rows, total_complete_rows);
+	return total_complete_rows;
+}
+
 /** Attempts to push the current piece down */
 bool board_push_current_piece_down(Board * b)
 {
@@ -397,39 +702,16 @@ bool board_push_current_piece_down(Board * b)
 	}
 	
 	if (is_on_bottom){
-		// remove the rows
-		board_place_piece(b, b->current_piece);
-		bool * completed_rows = board_find_completed_rows(b);
-		int total_complete_rows = count_true(completed_rows, b->height);
-		for (int y=b->height-1; y>=0; y--) {
-			if (completed_rows[y]) {
-				board_remove_row(b, y);
-			}
-		}
-		free(completed_rows);
-
-		// score the points
-		if (total_complete_rows == 1) {
-			b->score += 10;
-		} else if (total_complete_rows == 2) {
-			b->score += 25;
-		} else if (total_complete_rows == 3) {
-			b->score += 40;
-		} else if (total_complete_rows == 4) {
-			b->score += 55;
-		}
-		if (total_complete_rows > 0){
-			printf("Score is %i\n", b->score);
-		}
+		board_lock_piece(b, b->current_piece);
 
 		//		board_print(b);
-		Piece * next_piece = piece_create_random((b->width / 2), 2);
+		// The locked piece is part of the board now, so its memory becomes the next piece.
+		Piece * next_piece = b->current_piece;
+		piece_reset_type(next_piece, next_random(&b->rng_state) % PIECE_TYPE_COUNT, (b->width / 2), 2);
 		if (board_check_valid_placement(b, next_piece)){
-			piece_free(b->current_piece);
-			b->current_piece = next_piece;						
+			board_notify(b, BOARD_EVENT_SPAWN, next_piece, 0, 0);
 		} else {
-			piece_free(next_piece);
-			b->is_done = true;
+			board_top_out(b, TOP_OUT_SPAWN_BLOCKED);
 		}		
 	}
 	return result;
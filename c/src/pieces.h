@@ -1,4 +1,5 @@
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #define WIDTH 10
@@ -10,23 +11,97 @@
 typedef struct {
 	int x; 
 	int y;
-	char * color;
 } Point ;
 
 typedef struct {
 	/* The center point that blocks will rotate around */
 	Point * center; 
 	Point ** blocks;
+	/* One of the PieceType values, or -1 for a custom piece. */
+	int type;
+	/* Number of clockwise quarter turns since the piece was created, 0-3. */
+	int rotation;
+	/* The PALETTE index the piece is drawn with. */
+	int color;
 } Piece ;
 
-/** A board where (0,0) is on the top-left of the board. */
+/** The kinds of piece, in the order piece_create_type expects. */
+enum {
+	PIECE_LINE = 0,
+	PIECE_SQUARE,
+	PIECE_L_SHAPE1,
+	PIECE_L_SHAPE2,
+	PIECE_N_SHAPE1,
+	PIECE_N_SHAPE2,
+	PIECE_TYPE_COUNT
+};
+
+/** The letter each piece type goes by in piece sequences, indexed by PieceType. */
+extern const char PIECE_LETTERS[PIECE_TYPE_COUNT + 1];
+
+/** 
+ * Colors cells are drawn with. Index 0 is an empty cell, piece type t is
+ * t + 1 and the last entry is for blocks that didn't come from a piece.
+ */
+#define PALETTE_SIZE (PIECE_TYPE_COUNT + 2)
+extern const char * PALETTE[PALETTE_SIZE];
+
+/* Bits a cell takes in a board row, enough for any PALETTE index. */
+#define CELL_BITS 3
+#define CELL_MASK ((1u << CELL_BITS) - 1)
+
+/** Things that happen to a board, reported to its listener. */
+enum {
+	/* A new piece has become the current piece. */
+	BOARD_EVENT_SPAWN = 0,
+	/* A piece was added to the board; cleared_rows says which rows it completed. */
+	BOARD_EVENT_LOCK,
+	/* The next piece had no room, so the game is over. */
+	BOARD_EVENT_TOP_OUT,
+	/* The board was cleared for a new game. */
+	BOARD_EVENT_RESET,
+	/* Rows were pushed in from the bottom; cleared_count says how many. */
+	BOARD_EVENT_GARBAGE
+};
+
+/** Why a game ended, for BOARD_EVENT_TOP_OUT. */
+enum {
+	/* The next piece had nowhere to go. */
+	TOP_OUT_SPAWN_BLOCKED = 0,
+	/* Garbage pushed blocks off the top, or left the current piece nowhere to go. */
+	TOP_OUT_GARBAGE,
+	TOP_OUT_CAUSE_COUNT
+};
+
 typedef struct {
+	int kind;
+	Piece * piece;
+	/* Bit y is set for each row y removed by a lock. */
+	unsigned int cleared_rows;
+	int cleared_count;
+	/* One of the TOP_OUT causes, for a top out. */
+	int cause;
+} BoardEvent ;
+
+/** A board where (0,0) is on the top-left of the board. */
+typedef struct _board {
 	int height;
 	int width;
 	int score;
+	/* Total number of rows cleared this game. */
+	int lines;
 	bool is_done;
+	/* State of the board's own random number generator, so games can be replayed from a seed. */
+	unsigned int rng_state;
 	Piece * current_piece;
-	Point * placed_blocks[WIDTH][HEIGHT];
+	/* 
+	 * The placed blocks, one row per entry. Column x is the PALETTE index
+	 * at bit x * CELL_BITS, and 0 for an empty cell.
+	 */
+	uint32_t cells[HEIGHT];
+	/* Optional; told about spawns, locks and the end of the game. */
+	void (*listener) (struct _board * b, BoardEvent * event, void * data);
+	void * listener_data;
 } Board ;
 
 
@@ -48,10 +123,16 @@ Piece * l_shape1(int x, int y);
 Piece * l_shape2(int x, int y);
 Piece * n_shape1(int x, int y);
 Piece * n_shape2(int x, int y);
-Piece * piece_create(int center_x, int center_y, int coords[4][2], char * color);
+Piece * piece_create(int center_x, int center_y, int coords[4][2], int color);
+Piece * piece_create_type(int type, int x, int y);
+void piece_shape(int type, int rotation, int blocks[4][2]);
+void piece_reset_type(Piece * p, int type, int x, int y);
+int piece_type_from_letter(char letter);
 Piece * piece_create_random(int x, int y);
+Piece * piece_create_seeded(int x, int y, unsigned int * seed);
 Piece * piece_copy(Piece* p);
 void piece_down(Piece* p);
+void piece_up(Piece* p);
 void piece_free(Piece* p);
 void piece_left(Piece *p);
 void piece_right(Piece *p);
@@ -63,14 +144,25 @@ bool piece_equals(Piece *p1, Piece *p2);
 
 /** Board functions */
 Board * board_create();
+Board * board_create_seeded(unsigned int seed);
+Board * board_copy(Board * b);
+void board_reset(Board * b, unsigned int seed);
 void board_free (Board * b);
 bool board_is_row_complete(Board * b, int row);
 bool * board_find_completed_rows(Board * b);
 void board_place_piece(Board * b, Piece * p);
+int board_lock_piece(Board * b, Piece * p);
+bool board_add_garbage(Board * b, int rows, int hole_column);
+void board_top_out(Board * b, int cause);
 bool board_check_valid_placement(Board * b, Piece * p);
 bool board_push_current_piece_down(Board * b);
 bool board_can_piece_move_down(Board * b);
-Point * board_find_piece_at(Board * b, int x, int y);
+bool board_try_move(Board * b, void (*mutator) (Piece *), void (*inverse) (Piece *));
+int board_cell(Board * b, int x, int y);
+void board_set_cell(Board * b, int x, int y, int color);
+unsigned int board_row_mask(Board * b, int y);
+bool board_read(Board * b, FILE * file);
+void board_set_listener(Board * b, void (*listener) (Board *, BoardEvent *, void *), void * data);
 
 #endif /* PIECES_H */
 
@@ -0,0 +1,117 @@
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include "snapshot.h"
+
+/** 
+ * Write the board into image. Nothing is allocated, so this is cheap
+ * enough to call on every tick, but like every other board function it
+ * must not run while another thread changes the board.
+ */
+void board_save(Board * b, BoardImage * image)
+{
+	memset(image, 0, sizeof(BoardImage));
+	image->magic = BOARD_IMAGE_MAGIC;
+	image->version = BOARD_IMAGE_VERSION;
+	image->score = b->score;
+	image->lines = b->lines;
+	image->rng_state = b->rng_state;
+	image->width = b->width;
+	image->height = b->height;
+	image->is_done = b->is_done;
+
+	Piece * p = b->current_piece;
+	image->piece_type = p->type;
+	image->piece_rotation = p->rotation;
+	image->piece_x = p->center->x;
+	image->piece_y = p->center->y;
+	image->piece_color = p->color;
+	for (int i=0; i<4; i++) {
+		image->piece_blocks[i][0] = p->blocks[i]->x;
+		image->piece_blocks[i][1] = p->blocks[i]->y;
+	}
+	memcpy(image->cells, b->cells, sizeof(image->cells));
+}
+
+/** 
+ * Is the piece in image one a board could have: a known type, in one of
+ * its own rotations, and where the game allows it? A live game's piece
+ * must fit on cells; a finished game's may overlap blocks or sit above
+ * the board, but never beside or below it.
+ */
+static bool image_piece_is_valid(const BoardImage * image, uint32_t cells[HEIGHT], int width)
+{
+	if (image->piece_type < 0 || image->piece_type >= PIECE_TYPE_COUNT ||
+		image->piece_rotation < 0 || image->piece_rotation > 3) {
+		return false;
+	}
+	int shape[4][2];
+	piece_shape(image->piece_type, image->piece_rotation, shape);
+
+	Point center = {image->piece_x, image->piece_y};
+	Point points[4];
+	Point * blocks[4];
+	for (int i=0; i<4; i++) {
+		if (image->piece_blocks[i][0] != shape[i][0] || image->piece_blocks[i][1] != shape[i][1]) {
+			return false;
+		}
+		points[i] = (Point) {shape[i][0], shape[i][1]};
+		blocks[i] = &points[i];
+		int x = center.x + shape[i][0];
+		int y = center.y + shape[i][1];
+		if (x < 0 || x >= width || y >= HEIGHT) {
+			return false;
+		}
+	}
+	if (image->is_done) {
+		return true;
+	}
+	Piece piece = {&center, blocks, image->piece_type, image->piece_rotation, image->piece_color};
+	Board board;
+	board.width = width;
+	board.height = HEIGHT;
+	memcpy(board.cells, cells, sizeof(board.cells));
+	return board_check_valid_placement(&board, &piece);
+}
+
+/**
+ * Replace the board's game with the one in image. The current piece
+ * already on the board is reused, so nothing is allocated. Returns false,
+ * leaving the board alone, if the image is from another version or board
+ * size, or holds a piece the game could never have.
+ */
+bool board_restore(Board * b, const BoardImage * image)
+{
+	if (image->magic != BOARD_IMAGE_MAGIC || image->version != BOARD_IMAGE_VERSION ||
+		image->width != b->width || image->height != b->height ||
+		image->piece_color >= PALETTE_SIZE) {
+		return false;
+	}
+	// Bits past the last column would read as blocks nobody can see or clear.
+	uint32_t used = (1u << (b->width * CELL_BITS)) - 1;
+	uint32_t cells[HEIGHT] = {0};
+	for (int y=0; y<b->height; y++) {
+		cells[y] = image->cells[y] & used;
+	}
+	if (!image_piece_is_valid(image, cells, b->width)) {
+		return false;
+	}
+	b->score = image->score;
+	b->lines = image->lines;
+	b->rng_state = image->rng_state;
+	b->is_done = image->is_done;
+
+	Piece * p = b->current_piece;
+	p->type = image->piece_type;
+	p->rotation = image->piece_rotation;
+	p->center->x = image->piece_x;
+	p->center->y = image->piece_y;
+	for (int i=0; i<4; i++) {
+		p->blocks[i]->x = image->piece_blocks[i][0];
+		p->blocks[i]->y = image->piece_blocks[i][1];
+	}
+	p->color = image->piece_color;
+	memcpy(b->cells, cells, sizeof(b->cells));
+	return true;
+}
@@ -0,0 +1,45 @@
+/**
+ * Saving a complete game to a fixed-size binary image and restoring it.
+ *
+ * An image holds everything needed to carry on exactly where the game
+ * left off: the placed blocks, the current piece, the score and the
+ * board's random state, which also determines every piece still to come.
+ * Numbers are stored in the host's byte order.
+ */
+
+#include <stdint.h>
+#include "pieces.h"
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#define BOARD_IMAGE_MAGIC 0x31534254u
+#define BOARD_IMAGE_VERSION 2
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	int32_t score;
+	int32_t lines;
+	uint32_t rng_state;
+	uint8_t width;
+	uint8_t height;
+	uint8_t is_done;
+	/* The current piece, which board_restore checks against its type's shape. */
+	int8_t piece_type;
+	int8_t piece_rotation;
+	int8_t piece_x;
+	int8_t piece_y;
+	uint8_t piece_color;
+	int8_t piece_blocks[4][2];
+	/* The board's rows, packed the same way as Board.cells. */
+	uint32_t cells[HEIGHT];
+} BoardImage ;
+
+// Images are written out as raw bytes, so the layout mustn't depend on padding.
+_Static_assert(sizeof(BoardImage) == 36 + 4 * HEIGHT, "BoardImage has padding");
+
+void board_save(Board * b, BoardImage * image);
+bool board_restore(Board * b, const BoardImage * image);
+
+#endif /* SNAPSHOT_H */
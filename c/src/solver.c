@@ -0,0 +1,592 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <config.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "solver.h"
+
+/* Nodes nearer the root than this are always split into tasks. */
+#define SPLIT_DEPTH 1
+/* Below that, children are only handed to idle threads while this many pieces are left. */
+#define SHARE_MIN_PIECES 4
+#define STRIPES 64
+
+/** The rows a clear is being built in, top first, one bit per filled cell. */
+typedef struct {
+	uint16_t rows[SOLVER_MAX_HEIGHT];
+	int depth;
+	int limit;
+} DeadKey ;
+
+typedef struct {
+	pthread_mutex_t lock;
+	DeadKey * keys;
+	uint64_t * hashes;
+	size_t size;
+	size_t capacity;
+} Stripe ;
+
+typedef struct {
+	/* Copied by value; its current piece still belongs to the caller and is never touched. */
+	Board board;
+	int depth;
+	/* Rows left to clear; every block has to stay inside them. */
+	int limit;
+	/* The limit the search started with. */
+	int height;
+	Placement path[SOLVER_MAX_PIECES];
+} Task ;
+
+/** One worker's tasks. The owner works from the tail and thieves take from the head. */
+typedef struct {
+	pthread_mutex_t lock;
+	Task ** tasks;
+	int head;
+	int tail;
+	int capacity;
+} Deque ;
+
+typedef struct {
+	const int * sequence;
+	int length;
+	/* States known to have no clear, shared by all threads. */
+	Stripe dead[STRIPES];
+	Deque * deques;
+	int thread_count;
+	/* Tasks queued or running. The search is over when this reaches 0. */
+	int pending;
+	/* Guards posted; idle threads wait on wake for it to change or pending to reach 0. */
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	/* Bumped each time a task is queued. */
+	unsigned int posted;
+	/* Threads looking for work. */
+	int idle;
+	int found;
+	SolverSolution * solution;
+} Solver ;
+
+/** One ply of a worker's search. */
+typedef struct {
+	Board board;
+	/* Placements of the piece due at this ply that are worth trying. */
+	Placement placements[MOVEGEN_MAX_PLACEMENTS];
+} Ply ;
+
+/** A search thread, with scratch space allocated once so searching never allocates. */
+typedef struct {
+	Solver * solver;
+	int index;
+	Ply * plies;
+	Placement * found;
+	/* Every type of piece at its spawn rotation, and turned each way to be moved into place. */
+	Piece * spawns[PIECE_TYPE_COUNT];
+	Piece * rotated[PIECE_TYPE_COUNT][4];
+	/* The task being searched. */
+	Task * task;
+	pthread_t thread;
+} Worker ;
+
+/** Read the bottom limit rows of the board into rows. Returns the number of filled cells. */
+static int area_rows(Board * b, int limit, uint16_t * rows)
+{
+	int filled = 0;
+	for (int i=0; i<limit; i++) {
+		rows[i] = board_row_mask(b, b->height - limit + i);
+		filled += __builtin_popcount(rows[i]);
+	}
+	return filled;
+}
+
+/** 
+ * Whether the empty cells in the bottom limit rows could still be covered
+ * by whole pieces. Rows shift down as others clear, so any two empty cells
+ * in a column may come to touch, but cells in neighbouring columns only
+ * ever touch if they share a row. Each run of columns joined that way
+ * needs a multiple of 4 empty cells.
+ */
+static bool can_fill(uint16_t * rows, int limit, int width)
+{
+	int group = 0;
+	for (int x=0; x<width; x++) {
+		bool joined = false;
+		for (int i=0; i<limit; i++) {
+			if (!(rows[i] >> x & 1)) {
+				group++;
+				joined = joined || (x + 1 < width && !(rows[i] >> (x + 1) & 1));
+			}
+		}
+		if (!joined) {
+			if (group % 4 != 0) {
+				return false;
+			}
+			group = 0;
+		}
+	}
+	return true;
+}
+
+static uint64_t dead_hash(DeadKey * key)
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	const unsigned char * bytes = (const unsigned char *) key;
+	for (size_t i=0; i<sizeof(DeadKey); i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash | 1; // 0 marks an empty slot
+}
+
+static void stripe_grow(Stripe * s)
+{
+	size_t old_capacity = s->capacity;
+	DeadKey * old_keys = s->keys;
+	uint64_t * old_hashes = s->hashes;
+	s->capacity = old_capacity == 0 ? 1024 : old_capacity * 2;
+	s->keys = malloc(sizeof(DeadKey) * s->capacity);
+	s->hashes = calloc(s->capacity, sizeof(uint64_t));
+	for (size_t i=0; i<old_capacity; i++) {
+		if (old_hashes[i] != 0) {
+			size_t j = old_hashes[i] & (s->capacity - 1);
+			while (s->hashes[j] != 0) {
+				j = (j + 1) & (s->capacity - 1);
+			}
+			s->hashes[j] = old_hashes[i];
+			s->keys[j] = old_keys[i];
+		}
+	}
+	free(old_keys);
+	free(old_hashes);
+}
+
+/** Find key's slot in its stripe, which must be locked and not full. */
+static size_t stripe_find(Stripe * s, DeadKey * key, uint64_t hash)
+{
+	size_t i = hash & (s->capacity - 1);
+	while (s->hashes[i] != 0 && 
+		   (s->hashes[i] != hash || memcmp(&s->keys[i], key, sizeof(DeadKey)) != 0)) {
+		i = (i + 1) & (s->capacity - 1);
+	}
+	return i;
+}
+
+static bool dead_contains(Solver * solver, DeadKey * key)
+{
+	uint64_t hash = dead_hash(key);
+	Stripe * s = &solver->dead[(hash >> 58) % STRIPES];
+	pthread_mutex_lock(&s->lock);
+	bool found = s->capacity > 0 && s->hashes[stripe_find(s, key, hash)] != 0;
+	pthread_mutex_unlock(&s->lock);
+	return found;
+}
+
+static void dead_insert(Solver * solver, DeadKey * key)
+{
+	uint64_t hash = dead_hash(key);
+	Stripe * s = &solver->dead[(hash >> 58) % STRIPES];
+	pthread_mutex_lock(&s->lock);
+	if ((s->size + 1) * 10 > s->capacity * 7) {
+		stripe_grow(s);
+	}
+	size_t i = stripe_find(s, key, hash);
+	if (s->hashes[i] == 0) {
+		s->hashes[i] = hash;
+		s->keys[i] = *key;
+		s->size++;
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+/** Fill in the key for the bottom limit rows of b. */
+static void dead_key(Board * b, int depth, int limit, DeadKey * key)
+{
+	memset(key, 0, sizeof(DeadKey));
+	area_rows(b, limit, key->rows);
+	key->depth = depth;
+	key->limit = limit;
+}
+
+/** 
+ * The key of the board locking placed into rows would leave behind,
+ * worked out from the rows alone so hopeless children are never copied.
+ * Returns false if the piece sticks out above the bottom limit rows.
+ */
+static bool child_key(Board * b, uint16_t * rows, int limit, Piece * placed, int depth, DeadKey * key)
+{
+	uint16_t after[SOLVER_MAX_HEIGHT];
+	memcpy(after, rows, sizeof(uint16_t) * limit);
+	for (int j=0; j<4; j++) {
+		int y = placed->center->y + placed->blocks[j]->y - (b->height - limit);
+		if (y < 0) {
+			return false;
+		}
+		after[y] |= 1 << (placed->center->x + placed->blocks[j]->x);
+	}
+	memset(key, 0, sizeof(DeadKey));
+	int full = (1 << b->width) - 1;
+	for (int i=0; i<limit; i++) {
+		if (after[i] != full) {
+			key->rows[key->limit++] = after[i];
+		}
+	}
+	key->depth = depth;
+	return true;
+}
+
+static void deque_push(Deque * d, Task * t)
+{
+	pthread_mutex_lock(&d->lock);
+	if (d->tail == d->capacity) {
+		d->capacity = d->capacity == 0 ? 64 : d->capacity * 2;
+		d->tasks = realloc(d->tasks, sizeof(Task *) * d->capacity);
+	}
+	d->tasks[d->tail++] = t;
+	pthread_mutex_unlock(&d->lock);
+}
+
+/** Take a task from the tail, or the head if steal. */
+static Task * deque_take(Deque * d, bool steal)
+{
+	Task * t = NULL;
+	pthread_mutex_lock(&d->lock);
+	if (d->head < d->tail) {
+		t = steal ? d->tasks[d->head++] : d->tasks[--d->tail];
+		if (d->head == d->tail) {
+			d->head = 0;
+			d->tail = 0;
+		}
+	}
+	pthread_mutex_unlock(&d->lock);
+	return t;
+}
+
+/** 
+ * The piece due at depth, ready for move generation. Everything above the
+ * bottom limit rows is empty, so starting it just clear of them reaches
+ * the same placements as the spawn point with a smaller search.
+ */
+static Piece * spawn_piece(Worker * w, Board * b, int depth, int limit)
+{
+	Piece * p = w->spawns[w->solver->sequence[depth]];
+	int start_y = b->height - limit - MOVEGEN_MARGIN - 1;
+	p->center->x = b->width / 2;
+	p->center->y = start_y > 2 ? start_y : 2;
+	return p;
+}
+
+/** The piece spawn becomes at placement, as movegen_apply would leave it. */
+static Piece * place_piece(Worker * w, Piece * spawn, Placement * placement)
+{
+	Piece * p = w->rotated[spawn->type][placement->rotation];
+	p->center->x = placement->x;
+	p->center->y = placement->y;
+	return p;
+}
+
+/** 
+ * Find the placements of the piece due at depth that keep all blocks
+ * inside the bottom limit rows, could still be cleared with the pieces
+ * left and don't lead to a state already known to be dead. Returns how
+ * many were written to placements.
+ */
+static int expand(Worker * w, Board * b, int depth, int limit, Placement * placements)
+{
+	Solver * s = w->solver;
+	uint16_t rows[SOLVER_MAX_HEIGHT];
+	area_rows(b, limit, rows);
+	Piece * spawn = spawn_piece(w, b, depth, limit);
+	int count = movegen_find_placements_unordered(b, spawn, w->found);
+	int kept = 0;
+	for (int i=0; i<count; i++) {
+		DeadKey key;
+		if (child_key(b, rows, limit, place_piece(w, spawn, &w->found[i]), depth + 1, &key)) {
+			int filled = 0;
+			for (int y=0; y<key.limit; y++) {
+				filled += __builtin_popcount(key.rows[y]);
+			}
+			int needed = (b->width * key.limit - filled) / 4;
+			if (needed <= s->length - depth - 1 && can_fill(key.rows, key.limit, b->width) &&
+				!dead_contains(s, &key)) {
+				placements[kept++] = w->found[i];
+			}
+		}
+	}
+	return kept;
+}
+
+/** Lock the piece due at depth into a copy of b at child. Returns the child's limit. */
+static int make_child(Worker * w, Board * b, int depth, int limit, Placement * placement, Board * child)
+{
+	Piece * p = place_piece(w, spawn_piece(w, b, depth, limit), placement);
+	*child = *b;
+	return limit - board_lock_piece(child, p);
+}
+
+/** Queue t on the given thread's deque, and wake an idle thread to take it. */
+static void queue_task(Solver * s, int index, Task * t)
+{
+	// Counted before anyone can take it, so pending never drops to 0 early.
+	__atomic_add_fetch(&s->pending, 1, __ATOMIC_ACQ_REL);
+	deque_push(&s->deques[index], t);
+	pthread_mutex_lock(&s->lock);
+	s->posted++;
+	pthread_cond_signal(&s->wake);
+	pthread_mutex_unlock(&s->lock);
+}
+
+/** Mark a task done, waking every idle thread if it was the last one. */
+static void finish_task(Solver * s)
+{
+	if (__atomic_sub_fetch(&s->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+		pthread_mutex_lock(&s->lock);
+		pthread_cond_broadcast(&s->wake);
+		pthread_mutex_unlock(&s->lock);
+	}
+}
+
+/** Queue a child of b as a task for any thread to take. */
+static void share_child(Worker * w, Board * b, int depth, int limit, Placement * path, Placement * placement)
+{
+	Task * t = malloc(sizeof(Task));
+	t->limit = make_child(w, b, depth, limit, placement, &t->board);
+	t->depth = depth + 1;
+	t->height = w->task->height;
+	memcpy(t->path, path, sizeof(Placement) * depth);
+	t->path[depth] = *placement;
+	queue_task(w->solver, w->index, t);
+}
+
+/** 
+ * Depth first search below b, filling in path. Returns the number of
+ * pieces the clear took, or -1 if there is none here. While other threads
+ * are idle, children other than the first are handed to them instead.
+ */
+static int search(Worker * w, Board * b, int depth, int limit, Placement * path)
+{
+	Solver * s = w->solver;
+	if (limit == 0) {
+		return depth;
+	}
+	if (depth == s->length || __atomic_load_n(&s->found, __ATOMIC_RELAXED)) {
+		return -1;
+	}
+	Placement * placements = w->plies[depth].placements;
+	Board * child = &w->plies[depth + 1].board;
+	int count = expand(w, b, depth, limit, placements);
+	int result = -1;
+	bool shared = false;
+	for (int i=0; i<count && result < 0; i++) {
+		if (i > 0 && s->length - depth >= SHARE_MIN_PIECES &&
+			__atomic_load_n(&s->idle, __ATOMIC_RELAXED) > 0) {
+			share_child(w, b, depth, limit, path, &placements[i]);
+			shared = true;
+			continue;
+		}
+		path[depth] = placements[i];
+		int child_limit = make_child(w, b, depth, limit, &placements[i], child);
+		result = search(w, child, depth + 1, child_limit, path);
+	}
+
+	// Nothing is known about children someone else is searching, and a
+	// search cut short by another thread's success proves nothing.
+	if (result < 0 && !shared && !__atomic_load_n(&s->found, __ATOMIC_RELAXED)) {
+		DeadKey key;
+		dead_key(b, depth, limit, &key);
+		dead_insert(s, &key);
+	}
+	return result;
+}
+
+static void record_solution(Solver * s, Task * t, int count)
+{
+	if (__atomic_exchange_n(&s->found, 1, __ATOMIC_ACQ_REL) == 0) {
+		s->solution->count = count;
+		s->solution->height = t->height;
+		memcpy(s->solution->placements, t->path, sizeof(Placement) * count);
+	}
+}
+
+/** Near the root, queue every child for anyone to take; further down, search in place. */
+static void run_task(Worker * w, Task * t)
+{
+	Solver * s = w->solver;
+	w->task = t;
+	if (t->limit == 0 || t->depth >= SPLIT_DEPTH || t->depth == s->length) {
+		int count = search(w, &t->board, t->depth, t->limit, t->path);
+		if (count >= 0) {
+			record_solution(s, t, count);
+		}
+		return;
+	}
+
+	Placement * placements = w->plies[t->depth].placements;
+	int count = expand(w, &t->board, t->depth, t->limit, placements);
+	// Pushed last to first, so the owner takes them in move generation order.
+	for (int i=count-1; i>=0; i--) {
+		share_child(w, &t->board, t->depth, t->limit, t->path, &placements[i]);
+	}
+}
+
+/** Allocate a worker's scratch space, once for the whole search. */
+static void worker_init(Worker * w, Solver * s, int index)
+{
+	w->solver = s;
+	w->index = index;
+	w->plies = malloc(sizeof(Ply) * (SOLVER_MAX_PIECES + 1));
+	w->found = malloc(sizeof(Placement) * MOVEGEN_MAX_PLACEMENTS);
+	for (int i=0; i<PIECE_TYPE_COUNT; i++) {
+		w->spawns[i] = piece_create_type(i, 0, 0);
+		for (int r=0; r<4; r++) {
+			w->rotated[i][r] = piece_create_type(i, 0, 0);
+			movegen_apply(w->rotated[i][r], &(Placement) {0, 0, r});
+		}
+	}
+}
+
+static void worker_free(Worker * w)
+{
+	for (int i=0; i<PIECE_TYPE_COUNT; i++) {
+		piece_free(w->spawns[i]);
+		for (int r=0; r<4; r++) {
+			piece_free(w->rotated[i][r]);
+		}
+	}
+	free(w->found);
+	free(w->plies);
+}
+
+/** Take a task from this thread's deque, or steal one from another's. */
+static Task * find_task(Worker * w)
+{
+	Solver * s = w->solver;
+	Task * t = deque_take(&s->deques[w->index], false);
+	for (int i=1; t == NULL && i<s->thread_count; i++) {
+		t = deque_take(&s->deques[(w->index + i) % s->thread_count], true);
+	}
+	return t;
+}
+
+/** Run tasks until there are none queued or running. */
+static void * worker_run(void * arg)
+{
+	Worker * w = arg;
+	Solver * s = w->solver;
+	bool idle = false;
+	for (;;) {
+		pthread_mutex_lock(&s->lock);
+		unsigned int posted = s->posted;
+		pthread_mutex_unlock(&s->lock);
+
+		Task * t = find_task(w);
+		if (t == NULL) {
+			if (!idle) {
+				idle = true;
+				__atomic_add_fetch(&s->idle, 1, __ATOMIC_ACQ_REL);
+			}
+			// Sleep until something is queued after the look above, or everything is done.
+			pthread_mutex_lock(&s->lock);
+			while (s->posted == posted && __atomic_load_n(&s->pending, __ATOMIC_ACQUIRE) > 0) {
+				pthread_cond_wait(&s->wake, &s->lock);
+			}
+			pthread_mutex_unlock(&s->lock);
+			if (__atomic_load_n(&s->pending, __ATOMIC_ACQUIRE) == 0) {
+				break;
+			}
+			continue;
+		}
+		if (idle) {
+			idle = false;
+			__atomic_sub_fetch(&s->idle, 1, __ATOMIC_ACQ_REL);
+		}
+		// Once there is an answer the remaining tasks are just drained.
+		if (!__atomic_load_n(&s->found, __ATOMIC_ACQUIRE)) {
+			run_task(w, t);
+		}
+		free(t);
+		finish_task(s);
+	}
+	return NULL;
+}
+
+/** 
+ * Search for placements of the first pieces of sequence (PieceType values)
+ * that leave b empty, using thread_count threads. Each height is searched
+ * to the end before the next one up is tried, so the clear found is in as
+ * few rows as the pieces allow, however many threads there are. Returns
+ * false if there is none within SOLVER_MAX_HEIGHT rows; b is not changed
+ * either way.
+ */
+bool solver_find_perfect_clear(Board * b, const int * sequence, int length, int thread_count,
+							   SolverSolution * solution)
+{
+	Solver s;
+	memset(&s, 0, sizeof(Solver));
+	s.sequence = sequence;
+	s.length = length < SOLVER_MAX_PIECES ? length : SOLVER_MAX_PIECES;
+	s.thread_count = thread_count < 1 ? 1 : thread_count;
+	s.solution = solution;
+	s.deques = calloc(s.thread_count, sizeof(Deque));
+	for (int i=0; i<s.thread_count; i++) {
+		pthread_mutex_init(&s.deques[i].lock, NULL);
+	}
+	for (int i=0; i<STRIPES; i++) {
+		pthread_mutex_init(&s.dead[i].lock, NULL);
+	}
+	pthread_mutex_init(&s.lock, NULL);
+	pthread_cond_init(&s.wake, NULL);
+	Worker * workers = calloc(s.thread_count, sizeof(Worker));
+	for (int i=0; i<s.thread_count; i++) {
+		worker_init(&workers[i], &s, i);
+	}
+
+	int stack = 0;
+	int filled = 0;
+	for (int y=0; y<b->height; y++) {
+		int count = __builtin_popcount(board_row_mask(b, y));
+		if (count > 0 && stack == 0) {
+			stack = b->height - y;
+		}
+		filled += count;
+	}
+	// A dead state is dead whatever height it was reached from, so the table is kept throughout.
+	for (int h=stack > 0 ? stack : 1; h<=SOLVER_MAX_HEIGHT && !s.found; h++) {
+		uint16_t rows[SOLVER_MAX_HEIGHT];
+		int cells = b->width * h - filled;
+		area_rows(b, h, rows);
+		if (cells % 4 != 0 || cells / 4 > s.length || !can_fill(rows, h, b->width)) {
+			continue;
+		}
+		Task * t = calloc(1, sizeof(Task));
+		t->board = *b;
+		t->board.listener = NULL;
+		t->board.listener_data = NULL;
+		t->limit = h;
+		t->height = h;
+		s.idle = 0;
+		queue_task(&s, 0, t);
+		for (int i=0; i<s.thread_count; i++) {
+			pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]);
+		}
+		for (int i=0; i<s.thread_count; i++) {
+			pthread_join(workers[i].thread, NULL);
+		}
+	}
+
+	for (int i=0; i<s.thread_count; i++) {
+		worker_free(&workers[i]);
+		free(s.deques[i].tasks);
+		pthread_mutex_destroy(&s.deques[i].lock);
+	}
+	for (int i=0; i<STRIPES; i++) {
+		free(s.dead[i].keys);
+		free(s.dead[i].hashes);
+		pthread_mutex_destroy(&s.dead[i].lock);
+	}
+	pthread_cond_destroy(&s.wake);
+	pthread_mutex_destroy(&s.lock);
+	free(s.deques);
+	free(workers);
+	return s.found != 0;
+}
@@ -0,0 +1,29 @@
+/**
+ * Perfect clear solver: given a board and the pieces that will come, find
+ * where to put them so that the board ends up completely empty.
+ */
+
+#include "pieces.h"
+#include "movegen.h"
+
+#ifndef SOLVER_H
+#define SOLVER_H
+
+/* Longest piece sequence the solver looks at. */
+#define SOLVER_MAX_PIECES 32
+/* Clears are only searched for within this many rows from the bottom. */
+#define SOLVER_MAX_HEIGHT 8
+
+typedef struct {
+	/* Number of pieces used, from the start of the sequence. */
+	int count;
+	/* How many rows the clear was built in. */
+	int height;
+	/* Where each piece goes, in the order they are placed. */
+	Placement placements[SOLVER_MAX_PIECES];
+} SolverSolution ;
+
+bool solver_find_perfect_clear(Board * b, const int * sequence, int length, int thread_count,
+							   SolverSolution * solution);
+
+#endif /* SOLVER_H */
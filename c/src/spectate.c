@@ -0,0 +1,329 @@
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spectate.h"
+
+/** Size of the record starting with type, or 0 if type isn't a record. */
+static size_t record_size(uint8_t type)
+{
+	switch (type) {
+	case SPECTATE_KEYFRAME: return SPECTATE_KEYFRAME_SIZE;
+	case SPECTATE_SPAWN: return 5;
+	case SPECTATE_POSITION: return 4;
+	case SPECTATE_LOCK: return 9;
+	case SPECTATE_TOP_OUT: return 1;
+	default: return 0;
+	}
+}
+
+static void put_int32(uint8_t * out, uint32_t value)
+{
+	for (int i=0; i<4; i++) {
+		out[i] = (value >> (8 * i)) & 0xFF;
+	}
+}
+
+static uint32_t get_int32(const uint8_t * in)
+{
+	return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t) in[3] << 24);
+}
+
+/** Hub functions */
+SpectateHub * spectate_hub_create(size_t capacity)
+{
+	SpectateHub * hub = malloc(sizeof(SpectateHub));
+	hub->capacity = 1;
+	while (hub->capacity < capacity || hub->capacity < 4 * SPECTATE_MAX_RECORD) {
+		hub->capacity *= 2;
+	}
+	hub->ring = malloc(hub->capacity);
+	hub->written = 0;
+	hub->last_keyframe = 0;
+	hub->has_keyframe = false;
+	pthread_mutex_init(&hub->lock, NULL);
+	return hub;
+}
+
+void spectate_hub_free(SpectateHub * hub)
+{
+	pthread_mutex_destroy(&hub->lock);
+	free(hub->ring);
+	free(hub);
+}
+
+/** Append one encoded record. */
+static void spectate_hub_write(SpectateHub * hub, const uint8_t * record, size_t length)
+{
+	pthread_mutex_lock(&hub->lock);
+	if (record[0] == SPECTATE_KEYFRAME) {
+		hub->last_keyframe = hub->written;
+		hub->has_keyframe = true;
+	}
+	for (size_t i=0; i<length; i++) {
+		hub->ring[(hub->written + i) & (hub->capacity - 1)] = record[i];
+	}
+	hub->written += length;
+	pthread_mutex_unlock(&hub->lock);
+}
+
+void spectate_viewer_init(SpectateViewer * viewer)
+{
+	viewer->offset = 0;
+	viewer->started = false;
+}
+
+/**
+ * Copy whole records the viewer hasn't seen yet into out, at most max
+ * bytes. Viewers start at the newest keyframe, and a viewer that fell so
+ * far behind that its data was overwritten skips ahead to it. Returns the
+ * number of bytes copied, which is 0 until there is a keyframe to start at.
+ */
+size_t spectate_hub_read(SpectateHub * hub, SpectateViewer * viewer, uint8_t * out, size_t max)
+{
+	pthread_mutex_lock(&hub->lock);
+	uint64_t oldest = hub->written > hub->capacity ? hub->written - hub->capacity : 0;
+	if (!viewer->started || viewer->offset < oldest) {
+		// If even the newest keyframe was overwritten, wait for the next one.
+		if (!hub->has_keyframe || hub->last_keyframe < oldest) {
+			pthread_mutex_unlock(&hub->lock);
+			return 0;
+		}
+		viewer->offset = hub->last_keyframe;
+		viewer->started = true;
+	}
+
+	size_t copied = 0;
+	while (viewer->offset < hub->written) {
+		size_t size = record_size(hub->ring[viewer->offset & (hub->capacity - 1)]);
+		if (copied + size > max) {
+			break;
+		}
+		for (size_t i=0; i<size; i++) {
+			out[copied + i] = hub->ring[(viewer->offset + i) & (hub->capacity - 1)];
+		}
+		copied += size;
+		viewer->offset += size;
+	}
+	pthread_mutex_unlock(&hub->lock);
+	return copied;
+}
+
+
+
+/** Encoder functions */
+static void encode_keyframe(SpectateEncoder * encoder)
+{
+	Board * b = encoder->board;
+	uint8_t record[SPECTATE_KEYFRAME_SIZE];
+	memset(record, 0, sizeof(record));
+	record[0] = SPECTATE_KEYFRAME;
+	put_int32(record + 1, b->score);
+	for (int y=0; y<b->height; y++) {
+		for (int x=0; x<b->width; x++) {
+			int cell = y * b->width + x;
+			record[5 + cell / 2] |= board_cell(b, x, y) << (4 * (cell % 2));
+		}
+	}
+	spectate_hub_write(encoder->hub, record, sizeof(record));
+	encoder->locks_since_keyframe = 0;
+}
+
+/** Has enough been written since the last keyframe that it is at risk of being overwritten? */
+static bool keyframe_stale(SpectateHub * hub)
+{
+	pthread_mutex_lock(&hub->lock);
+	bool stale = !hub->has_keyframe || hub->written - hub->last_keyframe > hub->capacity / 2;
+	pthread_mutex_unlock(&hub->lock);
+	return stale;
+}
+
+static void encode_spawn(SpectateEncoder * encoder, Piece * p)
+{
+	uint8_t record[5] = {SPECTATE_SPAWN, p->type, p->center->x, p->center->y, p->rotation};
+	spectate_hub_write(encoder->hub, record, sizeof(record));
+	encoder->last_x = p->center->x;
+	encoder->last_y = p->center->y;
+	encoder->last_rotation = p->rotation;
+}
+
+/** 
+ * Write a keyframe if the last one is at risk of being overwritten, so
+ * there is always one in the ring to start from. Only called between
+ * changes; current is the piece in play, or NULL between a lock and the
+ * next spawn.
+ */
+static void refresh_keyframe(SpectateEncoder * encoder, Piece * current)
+{
+	if (keyframe_stale(encoder->hub)) {
+		encode_keyframe(encoder);
+		if (current != NULL) {
+			encode_spawn(encoder, current);
+		}
+	}
+}
+
+/** Write where p is, if it moved. Returns false if it didn't. */
+static bool write_position(SpectateEncoder * encoder, Piece * p)
+{
+	if (p->center->x == encoder->last_x && p->center->y == encoder->last_y &&
+		p->rotation == encoder->last_rotation) {
+		return false;
+	}
+	uint8_t record[4] = {SPECTATE_POSITION, p->center->x, p->center->y, p->rotation};
+	spectate_hub_write(encoder->hub, record, sizeof(record));
+	encoder->last_x = p->center->x;
+	encoder->last_y = p->center->y;
+	encoder->last_rotation = p->rotation;
+	return true;
+}
+
+static void encode_position(SpectateEncoder * encoder, Piece * p)
+{
+	if (write_position(encoder, p)) {
+		refresh_keyframe(encoder, p);
+	}
+}
+
+static void spectate_encoder_listen(Board * b, BoardEvent * event, void * data)
+{
+	SpectateEncoder * encoder = data;
+	if (event->kind == BOARD_EVENT_RESET || event->kind == BOARD_EVENT_GARBAGE) {
+		// Both change the whole board, so start over from a keyframe.
+		encode_keyframe(encoder);
+		encode_spawn(encoder, event->piece);
+	} else if (event->kind == BOARD_EVENT_SPAWN) {
+		if (encoder->locks_since_keyframe >= encoder->keyframe_interval) {
+			encode_keyframe(encoder);
+		}
+		encode_spawn(encoder, event->piece);
+		refresh_keyframe(encoder, event->piece);
+	} else if (event->kind == BOARD_EVENT_LOCK) {
+		// The board already holds the locked piece, so a keyframe has to wait until after the lock record.
+		write_position(encoder, event->piece);
+		uint8_t record[9];
+		record[0] = SPECTATE_LOCK;
+		put_int32(record + 1, event->cleared_rows);
+		put_int32(record + 5, b->score);
+		spectate_hub_write(encoder->hub, record, sizeof(record));
+		encoder->locks_since_keyframe++;
+		refresh_keyframe(encoder, NULL);
+	} else if (event->kind == BOARD_EVENT_TOP_OUT) {
+		uint8_t record = SPECTATE_TOP_OUT;
+		spectate_hub_write(encoder->hub, &record, 1);
+	}
+}
+
+/** 
+ * Start streaming the board into the hub. The encoder becomes the board's
+ * listener, and writes a keyframe straight away.
+ */
+SpectateEncoder * spectate_encoder_create(SpectateHub * hub, Board * b, int keyframe_interval)
+{
+	SpectateEncoder * encoder = malloc(sizeof(SpectateEncoder));
+	encoder->hub = hub;
+	encoder->board = b;
+	encoder->keyframe_interval = keyframe_interval;
+	encoder->locks_since_keyframe = 0;
+	board_set_listener(b, spectate_encoder_listen, encoder);
+	encode_keyframe(encoder);
+	encode_spawn(encoder, b->current_piece);
+	return encoder;
+}
+
+void spectate_encoder_free(SpectateEncoder * encoder)
+{
+	board_set_listener(encoder->board, NULL, NULL);
+	free(encoder);
+}
+
+/** Call after moving the current piece, to stream where it is now. */
+void spectate_encoder_update(SpectateEncoder * encoder)
+{
+	encode_position(encoder, encoder->board->current_piece);
+}
+
+
+
+/** View functions */
+void spectate_view_init(SpectateView * view)
+{
+	memset(view, 0, sizeof(SpectateView));
+	view->piece_type = -1;
+}
+
+static void view_lock(SpectateView * view, uint32_t cleared_rows)
+{
+	if (view->piece_type >= 0) {
+		Piece * p = piece_create_type(view->piece_type, view->piece_x, view->piece_y);
+		for (int r=0; r<view->piece_rotation; r++) {
+			piece_rotate_clockwise(p);
+		}
+		for (int i=0; i<4; i++) {
+			int x = p->blocks[i]->x + p->center->x;
+			int y = p->blocks[i]->y + p->center->y;
+			if (x >= 0 && x < WIDTH && y >= 0 && y < HEIGHT) {
+				view->cells[y][x] = view->piece_type + 1;
+			}
+		}
+		piece_free(p);
+	}
+	// Same order as the engine: top down, shifting the rows above each one down.
+	for (int row=0; row<HEIGHT; row++) {
+		if (cleared_rows & (1u << row)) {
+			memmove(view->cells[1], view->cells[0], row * WIDTH);
+			memset(view->cells[0], 0, WIDTH);
+		}
+	}
+	view->piece_type = -1;
+}
+
+/**
+ * Apply the whole records at the start of data to the view. Records before
+ * the first keyframe are skipped. Returns the number of bytes used; any
+ * rest is an incomplete record to pass again once more data arrives.
+ */
+size_t spectate_view_apply(SpectateView * view, const uint8_t * data, size_t length)
+{
+	size_t used = 0;
+	while (used < length) {
+		const uint8_t * record = data + used;
+		size_t size = record_size(record[0]);
+		if (size == 0 || used + size > length) {
+			break;
+		}
+		used += size;
+		if (!view->synced && record[0] != SPECTATE_KEYFRAME) {
+			continue;
+		}
+		switch (record[0]) {
+		case SPECTATE_KEYFRAME:
+			view->synced = true;
+			view->is_done = false;
+			view->score = (int32_t) get_int32(record + 1);
+			for (int cell=0; cell<WIDTH*HEIGHT; cell++) {
+				view->cells[cell / WIDTH][cell % WIDTH] = (record[5 + cell / 2] >> (4 * (cell % 2))) & 0x0F;
+			}
+			break;
+		case SPECTATE_SPAWN:
+			view->piece_type = record[1] < PIECE_TYPE_COUNT ? record[1] : -1;
+			view->piece_x = (int8_t) record[2];
+			view->piece_y = (int8_t) record[3];
+			view->piece_rotation = record[4];
+			break;
+		case SPECTATE_POSITION:
+			view->piece_x = (int8_t) record[1];
+			view->piece_y = (int8_t) record[2];
+			view->piece_rotation = record[3];
+			break;
+		case SPECTATE_LOCK:
+			view_lock(view, get_int32(record + 1));
+			view->score = (int32_t) get_int32(record + 5);
+			break;
+		case SPECTATE_TOP_OUT:
+			view->is_done = true;
+			break;
+		}
+	}
+	return used;
+}
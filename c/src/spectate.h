@@ -0,0 +1,95 @@
+/**
+ * Streaming games to spectators as a compact series of changes.
+ *
+ * An encoder listens to one board and appends records to a hub: piece
+ * spawns, piece positions, locks with the mask of cleared rows, and now
+ * and then a keyframe holding the whole board. The hub keeps the encoded
+ * bytes in one ring that every viewer reads from at its own offset, so a
+ * game is encoded once no matter how many people watch it.
+ *
+ * Records start with one of the SPECTATE_* bytes; multi-byte numbers are
+ * little endian.
+ *   K score:4 cells:WIDTH*HEIGHT/2   keyframe, one palette index per nibble
+ *   S type:1 x:1 y:1 rotation:1      a new current piece
+ *   P x:1 y:1 rotation:1             the current piece moved
+ *   L cleared_rows:4 score:4         the current piece locked
+ *   T                                the game is over
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "pieces.h"
+
+#ifndef SPECTATE_H
+#define SPECTATE_H
+
+#define SPECTATE_KEYFRAME 'K'
+#define SPECTATE_SPAWN 'S'
+#define SPECTATE_POSITION 'P'
+#define SPECTATE_LOCK 'L'
+#define SPECTATE_TOP_OUT 'T'
+
+#define SPECTATE_KEYFRAME_SIZE (5 + WIDTH * HEIGHT / 2)
+/* Longest record; decoders need at least this much buffered to make progress. */
+#define SPECTATE_MAX_RECORD SPECTATE_KEYFRAME_SIZE
+
+/** Encoded bytes of one game, shared by all of its viewers. */
+typedef struct {
+	pthread_mutex_t lock;
+	uint8_t * ring;
+	/* A power of two. */
+	size_t capacity;
+	/* Total bytes ever written; the ring holds the last capacity of them. */
+	uint64_t written;
+	/* Where the newest keyframe starts, so new and lagging viewers can start there. */
+	uint64_t last_keyframe;
+	bool has_keyframe;
+} SpectateHub ;
+
+/** How far one viewer has read. */
+typedef struct {
+	uint64_t offset;
+	bool started;
+} SpectateViewer ;
+
+typedef struct {
+	SpectateHub * hub;
+	Board * board;
+	/* 
+	 * A keyframe is written at the first spawn after this many locks, and
+	 * whenever the last one is half the ring behind.
+	 */
+	int keyframe_interval;
+	int locks_since_keyframe;
+	int last_x;
+	int last_y;
+	int last_rotation;
+} SpectateEncoder ;
+
+/** A spectator's copy of the game, rebuilt from the stream. */
+typedef struct {
+	uint8_t cells[HEIGHT][WIDTH];
+	int score;
+	bool is_done;
+	int piece_type;
+	int piece_x;
+	int piece_y;
+	int piece_rotation;
+	/* False until the first keyframe has been seen. */
+	bool synced;
+} SpectateView ;
+
+SpectateHub * spectate_hub_create(size_t capacity);
+void spectate_hub_free(SpectateHub * hub);
+void spectate_viewer_init(SpectateViewer * viewer);
+size_t spectate_hub_read(SpectateHub * hub, SpectateViewer * viewer, uint8_t * out, size_t max);
+
+SpectateEncoder * spectate_encoder_create(SpectateHub * hub, Board * b, int keyframe_interval);
+void spectate_encoder_free(SpectateEncoder * encoder);
+void spectate_encoder_update(SpectateEncoder * encoder);
+
+void spectate_view_init(SpectateView * view);
+size_t spectate_view_apply(SpectateView * view, const uint8_t * data, size_t length);
+
+#endif /* SPECTATE_H */
@@ -0,0 +1,306 @@
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stats.h"
+
+static const char * TOP_OUT_NAMES[TOP_OUT_CAUSE_COUNT] = {"spawn blocked", "garbage"};
+
+/** 
+ * Values below HISTOGRAM_SUB_COUNT get a bucket each. Above that, every
+ * power of two is split into HISTOGRAM_SUB_COUNT buckets by the bits
+ * after the highest one.
+ */
+static int bucket_index(uint32_t value)
+{
+	if (value < HISTOGRAM_SUB_COUNT) {
+		return value;
+	}
+	int top = 31 - __builtin_clz(value);
+	int shift = top - HISTOGRAM_SUB_BITS;
+	return (shift + 1) * HISTOGRAM_SUB_COUNT + (int) ((value >> shift) - HISTOGRAM_SUB_COUNT);
+}
+
+static uint64_t bucket_low(int index)
+{
+	if (index < HISTOGRAM_SUB_COUNT) {
+		return index;
+	}
+	int shift = index / HISTOGRAM_SUB_COUNT - 1;
+	return (uint64_t) (HISTOGRAM_SUB_COUNT + index % HISTOGRAM_SUB_COUNT) << shift;
+}
+
+static uint64_t bucket_width(int index)
+{
+	return index < HISTOGRAM_SUB_COUNT ? 1 : 1ull << (index / HISTOGRAM_SUB_COUNT - 1);
+}
+
+/** Histogram functions */
+void histogram_record(Histogram * h, uint32_t value)
+{
+	if (h->count == 0 || value < h->min) {
+		h->min = value;
+	}
+	if (h->count == 0 || value > h->max) {
+		h->max = value;
+	}
+	h->count++;
+	h->sum += value;
+	h->buckets[bucket_index(value)]++;
+}
+
+void histogram_merge(Histogram * into, const Histogram * from)
+{
+	if (from->count == 0) {
+		return;
+	}
+	if (into->count == 0 || from->min < into->min) {
+		into->min = from->min;
+	}
+	if (into->count == 0 || from->max > into->max) {
+		into->max = from->max;
+	}
+	into->count += from->count;
+	into->sum += from->sum;
+	for (int i=0; i<HISTOGRAM_BUCKETS; i++) {
+		into->buckets[i] += from->buckets[i];
+	}
+}
+
+/** 
+ * The value that a fraction q of the recorded values are at or below,
+ * give or take the width of its bucket. Returns 0 for an empty histogram.
+ */
+uint32_t histogram_quantile(const Histogram * h, double q)
+{
+	if (h->count == 0) {
+		return 0;
+	}
+	uint64_t rank = (uint64_t) (q * h->count + 0.5);
+	rank = rank < 1 ? 1 : (rank > h->count ? h->count : rank);
+	uint64_t seen = 0;
+	for (int i=0; i<HISTOGRAM_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank) {
+			uint64_t value = bucket_low(i) + bucket_width(i) / 2;
+			value = value < h->min ? h->min : value;
+			return value > h->max ? h->max : value;
+		}
+	}
+	return h->max;
+}
+
+double histogram_mean(const Histogram * h)
+{
+	return h->count == 0 ? 0 : (double) h->sum / h->count;
+}
+
+
+
+/** GameStats functions */
+void stats_init(GameStats * stats)
+{
+	memset(stats, 0, sizeof(GameStats));
+}
+
+void stats_merge(GameStats * into, const GameStats * from)
+{
+	into->games += from->games;
+	into->stopped += from->stopped;
+	histogram_merge(&into->score, &from->score);
+	histogram_merge(&into->lines, &from->lines);
+	histogram_merge(&into->length, &from->length);
+	for (int i=0; i<PIECE_TYPE_COUNT; i++) {
+		into->pieces[i] += from->pieces[i];
+	}
+	for (int i=0; i<STATS_CLEAR_BUCKETS; i++) {
+		into->clears[i] += from->clears[i];
+	}
+	for (int i=0; i<TOP_OUT_CAUSE_COUNT; i++) {
+		into->top_outs[i] += from->top_outs[i];
+	}
+}
+
+static void record_game(StatsRecorder * r, Board * b)
+{
+	GameStats * stats = r->stats;
+	stats->games++;
+	histogram_record(&stats->score, b->score);
+	histogram_record(&stats->lines, b->lines);
+	histogram_record(&stats->length, r->pieces);
+	r->pieces = 0;
+}
+
+static void recorder_listener(Board * b, BoardEvent * event, void * data)
+{
+	StatsRecorder * r = data;
+	if (event->kind == BOARD_EVENT_LOCK) {
+		r->pieces++;
+		// Custom pieces have no type to count.
+		int type = event->piece->type;
+		if (type >= 0 && type < PIECE_TYPE_COUNT) {
+			r->stats->pieces[type]++;
+		}
+		// Loaded boards and garbage can complete more rows than one piece covers.
+		int cleared = event->cleared_count;
+		r->stats->clears[cleared < STATS_CLEAR_BUCKETS ? cleared : STATS_CLEAR_BUCKETS - 1]++;
+	} else if (event->kind == BOARD_EVENT_TOP_OUT) {
+		if (event->cause >= 0 && event->cause < TOP_OUT_CAUSE_COUNT) {
+			r->stats->top_outs[event->cause]++;
+		}
+		record_game(r, b);
+	} else if (event->kind == BOARD_EVENT_RESET) {
+		r->pieces = 0;
+	}
+}
+
+/** 
+ * Record every game played on b into stats, until the board gets another
+ * listener. Games count from the board's next reset.
+ */
+void stats_recorder_attach(StatsRecorder * r, GameStats * stats, Board * b)
+{
+	r->stats = stats;
+	r->pieces = 0;
+	board_set_listener(b, recorder_listener, r);
+}
+
+/** Record the game on b as it stands, if it's still going, and count it as stopped. */
+void stats_recorder_stop(StatsRecorder * r, Board * b)
+{
+	if (!b->is_done) {
+		r->stats->stopped++;
+		record_game(r, b);
+	}
+}
+
+/** Report files */
+static bool write_u64(uint64_t value, FILE * file)
+{
+	return fwrite(&value, sizeof(value), 1, file) == 1;
+}
+
+static bool read_u64(uint64_t * value, FILE * file)
+{
+	return fread(value, sizeof(*value), 1, file) == 1;
+}
+
+/** Histograms are written sparsely: how many buckets are used, then index and count for each. */
+static bool write_histogram(const Histogram * h, FILE * file)
+{
+	uint64_t used = 0;
+	for (int i=0; i<HISTOGRAM_BUCKETS; i++) {
+		used += h->buckets[i] != 0;
+	}
+	bool ok = write_u64(h->count, file) && write_u64(h->sum, file) && 
+		write_u64(h->min, file) && write_u64(h->max, file) && write_u64(used, file);
+	for (int i=0; i<HISTOGRAM_BUCKETS && ok; i++) {
+		if (h->buckets[i] != 0) {
+			ok = write_u64(i, file) && write_u64(h->buckets[i], file);
+		}
+	}
+	return ok;
+}
+
+static bool read_histogram(Histogram * h, FILE * file)
+{
+	uint64_t min, max, used, index, count;
+	memset(h, 0, sizeof(Histogram));
+	if (!read_u64(&h->count, file) || !read_u64(&h->sum, file) ||
+		!read_u64(&min, file) || !read_u64(&max, file) || !read_u64(&used, file)) {
+		return false;
+	}
+	h->min = min;
+	h->max = max;
+	for (uint64_t i=0; i<used; i++) {
+		if (!read_u64(&index, file) || !read_u64(&count, file) || index >= HISTOGRAM_BUCKETS) {
+			return false;
+		}
+		h->buckets[index] = count;
+	}
+	return true;
+}
+
+/** 
+ * Write stats to a report file that stats_read can load back, so reports
+ * from separate runs can be merged. Numbers are in the host's byte order.
+ */
+bool stats_write(const GameStats * stats, FILE * file)
+{
+	uint32_t header[2] = {STATS_REPORT_MAGIC, STATS_REPORT_VERSION};
+	bool ok = fwrite(header, sizeof(header), 1, file) == 1 &&
+		write_u64(stats->games, file) && write_u64(stats->stopped, file) &&
+		write_histogram(&stats->score, file) && write_histogram(&stats->lines, file) && 
+		write_histogram(&stats->length, file);
+	for (int i=0; i<PIECE_TYPE_COUNT && ok; i++) {
+		ok = write_u64(stats->pieces[i], file);
+	}
+	for (int i=0; i<STATS_CLEAR_BUCKETS && ok; i++) {
+		ok = write_u64(stats->clears[i], file);
+	}
+	for (int i=0; i<TOP_OUT_CAUSE_COUNT && ok; i++) {
+		ok = write_u64(stats->top_outs[i], file);
+	}
+	return ok;
+}
+
+/** Load a report written by stats_write. Returns false if it isn't one, or is cut short. */
+bool stats_read(GameStats * stats, FILE * file)
+{
+	uint32_t header[2];
+	stats_init(stats);
+	bool ok = fread(header, sizeof(header), 1, file) == 1 &&
+		header[0] == STATS_REPORT_MAGIC && header[1] == STATS_REPORT_VERSION &&
+		read_u64(&stats->games, file) && read_u64(&stats->stopped, file) &&
+		read_histogram(&stats->score, file) && read_histogram(&stats->lines, file) && 
+		read_histogram(&stats->length, file);
+	for (int i=0; i<PIECE_TYPE_COUNT && ok; i++) {
+		ok = read_u64(&stats->pieces[i], file);
+	}
+	for (int i=0; i<STATS_CLEAR_BUCKETS && ok; i++) {
+		ok = read_u64(&stats->clears[i], file);
+	}
+	for (int i=0; i<TOP_OUT_CAUSE_COUNT && ok; i++) {
+		ok = read_u64(&stats->top_outs[i], file);
+	}
+	return ok;
+}
+
+static void print_histogram(const char * name, const Histogram * h, FILE * out)
+{
+	fprintf(out, "%-8s %10.1f %8u %8u %8u %8u %8u\n", name, histogram_mean(h), h->min,
+			histogram_quantile(h, 0.5), histogram_quantile(h, 0.9), histogram_quantile(h, 0.99), h->max);
+}
+
+static double percent(uint64_t part, uint64_t total)
+{
+	return total == 0 ? 0 : 100.0 * part / total;
+}
+
+void stats_print(const GameStats * stats, FILE * out)
+{
+	fprintf(out, "%llu games, %llu stopped before the end\n", 
+			(unsigned long long) stats->games, (unsigned long long) stats->stopped);
+	fprintf(out, "%-8s %10s %8s %8s %8s %8s %8s\n", "", "mean", "min", "p50", "p90", "p99", "max");
+	print_histogram("score", &stats->score, out);
+	print_histogram("lines", &stats->lines, out);
+	print_histogram("pieces", &stats->length, out);
+
+	uint64_t locks = 0;
+	for (int i=0; i<STATS_CLEAR_BUCKETS; i++) {
+		locks += stats->clears[i];
+	}
+	fprintf(out, "types   ");
+	for (int i=0; i<PIECE_TYPE_COUNT; i++) {
+		fprintf(out, " %c %.1f%%", PIECE_LETTERS[i], percent(stats->pieces[i], locks));
+	}
+	fprintf(out, "\nclears  ");
+	for (int i=1; i<STATS_CLEAR_BUCKETS; i++) {
+		fprintf(out, " %i%sx %llu", i, i == STATS_CLEAR_BUCKETS - 1 ? "+" : "", 
+				(unsigned long long) stats->clears[i]);
+	}
+	fprintf(out, "\ntop outs");
+	for (int i=0; i<TOP_OUT_CAUSE_COUNT; i++) {
+		fprintf(out, " %s %llu", TOP_OUT_NAMES[i], (unsigned long long) stats->top_outs[i]);
+	}
+	fprintf(out, "\n");
+}
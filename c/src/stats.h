@@ -0,0 +1,69 @@
+/**
+ * Statistics over many games, gathered as they are played.
+ *
+ * Nothing is kept per game: distributions go into log-bucketed
+ * histograms with a fixed number of buckets, so memory doesn't grow with
+ * the number of games. Each worker thread keeps its own GameStats, and
+ * they are merged at the end. Histograms have a relative error of at most
+ * 1 / HISTOGRAM_SUB_COUNT; values below HISTOGRAM_SUB_COUNT are exact.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "pieces.h"
+
+#ifndef STATS_H
+#define STATS_H
+
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((32 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT)
+
+/* Locks are counted by rows cleared, with the last bucket for 4 or more. */
+#define STATS_CLEAR_BUCKETS 5
+
+#define STATS_REPORT_MAGIC 0x52545354u
+#define STATS_REPORT_VERSION 1
+
+typedef struct {
+	uint64_t count;
+	uint64_t sum;
+	uint32_t min;
+	uint32_t max;
+	uint64_t buckets[HISTOGRAM_BUCKETS];
+} Histogram ;
+
+typedef struct {
+	/* Games recorded, including ones stopped before they were over. */
+	uint64_t games;
+	uint64_t stopped;
+	Histogram score;
+	Histogram lines;
+	/* Pieces locked in each game. */
+	Histogram length;
+	uint64_t pieces[PIECE_TYPE_COUNT];
+	/* Locks that cleared 0, 1, 2, 3 and 4 or more rows. */
+	uint64_t clears[STATS_CLEAR_BUCKETS];
+	uint64_t top_outs[TOP_OUT_CAUSE_COUNT];
+} GameStats ;
+
+/** Follows one board's games, adding each one to stats when it ends. */
+typedef struct {
+	GameStats * stats;
+	uint32_t pieces;
+} StatsRecorder ;
+
+void histogram_record(Histogram * h, uint32_t value);
+void histogram_merge(Histogram * into, const Histogram * from);
+uint32_t histogram_quantile(const Histogram * h, double q);
+double histogram_mean(const Histogram * h);
+
+void stats_init(GameStats * stats);
+void stats_merge(GameStats * into, const GameStats * from);
+void stats_recorder_attach(StatsRecorder * r, GameStats * stats, Board * b);
+void stats_recorder_stop(StatsRecorder * r, Board * b);
+bool stats_write(const GameStats * stats, FILE * file);
+bool stats_read(GameStats * stats, FILE * file);
+void stats_print(const GameStats * stats, FILE * out);
+
+#endif /* STATS_H */
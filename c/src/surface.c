@@ -0,0 +1,133 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <config.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "surface.h"
+
+/** Number of distinct shapes when steps range over -max_step..max_step. */
+uint32_t surface_signature_count(int max_step)
+{
+	uint32_t count = 1;
+	for (int i=0; i<WIDTH-1; i++) {
+		count *= 2 * max_step + 1;
+	}
+	return count;
+}
+
+/** 
+ * Work out the shape of the top of the stack. Returns false if two
+ * neighbouring columns differ by more than max_step.
+ */
+bool surface_signature(Board * b, int max_step, uint32_t * signature)
+{
+	int heights[WIDTH];
+	for (int x=0; x<b->width; x++) {
+		heights[x] = 0;
+		for (int y=0; y<b->height; y++) {
+			if (board_cell(b, x, y) != 0) {
+				heights[x] = b->height - y;
+				break;
+			}
+		}
+	}
+	uint32_t result = 0;
+	for (int x=b->width-2; x>=0; x--) {
+		int step = heights[x+1] - heights[x];
+		if (step < -max_step || step > max_step) {
+			return false;
+		}
+		result = result * (2 * max_step + 1) + (step + max_step);
+	}
+	*signature = result;
+	return true;
+}
+
+/** Pack a hard drop, rotation then column of the center, into one entry. */
+uint8_t surface_encode(int rotation, int x)
+{
+	return (rotation << 4) | (x + MOVEGEN_MARGIN);
+}
+
+void surface_decode(uint8_t entry, int * rotation, int * x)
+{
+	*rotation = entry >> 4;
+	*x = (entry & 0x0F) - MOVEGEN_MARGIN;
+}
+
+/** Map a table written by tetris-surface-gen. Returns NULL if it can't be used. */
+SurfaceTable * surface_table_open(const char * path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(SurfaceTableHeader)) {
+		close(fd);
+		return NULL;
+	}
+	void * address = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (address == MAP_FAILED) {
+		return NULL;
+	}
+	SurfaceTable * table = malloc(sizeof(SurfaceTable));
+	table->header = address;
+	table->entries = (const uint8_t *) address + sizeof(SurfaceTableHeader);
+	table->size = info.st_size;
+
+	const SurfaceTableHeader * h = table->header;
+	if (h->magic != SURFACE_MAGIC || h->version != SURFACE_VERSION || h->width != WIDTH ||
+		h->piece_types != PIECE_TYPE_COUNT || h->max_step < 1 || h->max_step > SURFACE_MAX_STEP ||
+		h->signature_count != surface_signature_count(h->max_step) ||
+		sizeof(SurfaceTableHeader) + (size_t) h->piece_types * h->signature_count > table->size) {
+		surface_table_close(table);
+		return NULL;
+	}
+	return table;
+}
+
+void surface_table_close(SurfaceTable * table)
+{
+	munmap((void *) table->header, table->size);
+	free(table);
+}
+
+/** 
+ * Look up where to drop p, which must be in its spawn position. Returns
+ * false on a miss: the shape isn't in the table or the drop is blocked.
+ */
+bool surface_table_lookup(SurfaceTable * table, Board * b, Piece * p, Placement * out)
+{
+	uint32_t signature;
+	if (p->type < 0 || !surface_signature(b, table->header->max_step, &signature)) {
+		return false;
+	}
+	uint8_t entry = table->entries[(size_t) p->type * table->header->signature_count + signature];
+	if (entry == SURFACE_MISS) {
+		return false;
+	}
+	int rotation;
+	int x;
+	surface_decode(entry, &rotation, &x);
+	return movegen_drop(b, p, rotation, x, out);
+}
+
+/** 
+ * Like ai_play_move, but try the table first and only search on a miss.
+ * Returns false once the game is over.
+ */
+bool surface_table_play_move(SurfaceTable * table, Board * b, const AiWeights * w)
+{
+	Placement placement;
+	if (!surface_table_lookup(table, b, b->current_piece, &placement)) {
+		return ai_play_move(b, w);
+	}
+	movegen_apply(b->current_piece, &placement);
+	board_push_current_piece_down(b);
+	return !b->is_done;
+}
@@ -0,0 +1,56 @@
+/**
+ * A precomputed table of where to put each piece, keyed by the shape of
+ * the top of the stack.
+ *
+ * The shape is the height difference between neighbouring columns. When
+ * every difference is within max_step, the best hard drop for that shape
+ * and piece is one memory-mapped byte away; otherwise the caller falls
+ * back to a full search.
+ */
+
+#include <stdint.h>
+#include "pieces.h"
+#include "movegen.h"
+#include "ai.h"
+
+#ifndef SURFACE_H
+#define SURFACE_H
+
+#define SURFACE_MAGIC 0x46525354u
+#define SURFACE_VERSION 1
+/* 
+ * Largest max_step a table may use. Tables hold (2 * max_step + 1) to the
+ * power WIDTH - 1 entries per piece: 7^9, about 240MB for all pieces, at
+ * 3, and ten times that at 4.
+ */
+#define SURFACE_MAX_STEP 3
+/* Entry for shapes with no usable placement. */
+#define SURFACE_MISS 0xFF
+
+/** The file starts with this header, followed by piece_types * signature_count entries. */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;
+	uint32_t max_step;
+	uint32_t piece_types;
+	uint32_t signature_count;
+} SurfaceTableHeader ;
+
+typedef struct {
+	const SurfaceTableHeader * header;
+	const uint8_t * entries;
+	size_t size;
+} SurfaceTable ;
+
+uint32_t surface_signature_count(int max_step);
+bool surface_signature(Board * b, int max_step, uint32_t * signature);
+uint8_t surface_encode(int rotation, int x);
+void surface_decode(uint8_t entry, int * rotation, int * x);
+
+SurfaceTable * surface_table_open(const char * path);
+void surface_table_close(SurfaceTable * table);
+bool surface_table_lookup(SurfaceTable * table, Board * b, Piece * p, Placement * out);
+bool surface_table_play_move(SurfaceTable * table, Board * b, const AiWeights * w);
+
+#endif /* SURFACE_H */
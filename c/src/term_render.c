@@ -0,0 +1,141 @@
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include "term_render.h"
+
+/* xterm-256 background color for each PALETTE entry. */
+static const char * BACKGROUNDS[PALETTE_SIZE] = {
+	"\x1b[0m", "\x1b[48;5;21m", "\x1b[48;5;124m", "\x1b[48;5;76m",
+	"\x1b[48;5;208m", "\x1b[48;5;39m", "\x1b[48;5;54m", "\x1b[48;5;244m"
+};
+
+/* Marks a front cell as unknown, so the first frame is drawn in full. */
+#define UNKNOWN_COLOR 0xFF
+
+TermRenderer * term_renderer_create(int tiles_across, int tiles_down)
+{
+	TermRenderer * tr = malloc(sizeof(TermRenderer));
+	tr->tiles_across = tiles_across;
+	tr->tiles_down = tiles_down;
+	tr->columns = tiles_across * TERM_TILE_WIDTH;
+	tr->rows = tiles_down * TERM_TILE_HEIGHT;
+	int cells = tr->columns * tr->rows;
+	tr->front = malloc(sizeof(TermCell) * cells);
+	tr->back = malloc(sizeof(TermCell) * cells);
+	for (int i=0; i<cells; i++) {
+		tr->front[i] = (TermCell) {' ', UNKNOWN_COLOR};
+		tr->back[i] = (TermCell) {' ', 0};
+	}
+	// Enough for a full redraw: every cell with a cursor move and a color change.
+	tr->output_capacity = (size_t) cells * 32 + 64;
+	tr->output = malloc(tr->output_capacity);
+	tr->output_size = 0;
+	return tr;
+}
+
+void term_renderer_free(TermRenderer * tr)
+{
+	free(tr->front);
+	free(tr->back);
+	free(tr->output);
+	free(tr);
+}
+
+static void put_cell(TermRenderer * tr, int column, int row, char character, uint8_t color)
+{
+	if (column >= 0 && column < tr->columns && row >= 0 && row < tr->rows) {
+		tr->back[row * tr->columns + column] = (TermCell) {character, color};
+	}
+}
+
+static void put_block(TermRenderer * tr, int left, int top, int x, int y, uint8_t color)
+{
+	put_cell(tr, left + 1 + 2 * x, top + 1 + y, ' ', color);
+	put_cell(tr, left + 2 + 2 * x, top + 1 + y, ' ', color);
+}
+
+/** Draw the board, with its current piece, into tile number tile of the next frame. */
+void term_renderer_draw_board(TermRenderer * tr, int tile, Board * b, const char * label)
+{
+	int left = (tile % tr->tiles_across) * TERM_TILE_WIDTH;
+	int top = (tile / tr->tiles_across) * TERM_TILE_HEIGHT;
+
+	// The label on the left and the score on the right.
+	char text[TERM_TILE_WIDTH + 1];
+	snprintf(text, sizeof(text), "%-*.*s%8i", TERM_TILE_WIDTH - 8, TERM_TILE_WIDTH - 8,
+			 label, b->score);
+	for (int i=0; i<TERM_TILE_WIDTH; i++) {
+		put_cell(tr, left + i, top, text[i] != '\0' ? text[i] : ' ', 0);
+	}
+
+	for (int y=0; y<b->height; y++) {
+		put_cell(tr, left, top + 1 + y, '|', 0);
+		put_cell(tr, left + 1 + 2 * b->width, top + 1 + y, '|', 0);
+		for (int x=0; x<b->width; x++) {
+			put_block(tr, left, top, x, y, board_cell(b, x, y));
+		}
+	}
+	for (int i=0; i<2 * b->width + 2; i++) {
+		put_cell(tr, left + i, top + 1 + b->height, '-', 0);
+	}
+
+	Piece * p = b->current_piece;
+	if (!b->is_done) {
+		for (int i=0; i<4; i++) {
+			put_block(tr, left, top, p->blocks[i]->x + p->center->x,
+					  p->blocks[i]->y + p->center->y, p->color);
+		}
+	}
+}
+
+static void append(TermRenderer * tr, const char * text, size_t length)
+{
+	memcpy(tr->output + tr->output_size, text, length);
+	tr->output_size += length;
+}
+
+/**
+ * Send the cells that changed since the last flush to out, in one write.
+ * Returns the number of bytes written.
+ */
+size_t term_renderer_flush(TermRenderer * tr, FILE * out)
+{
+	tr->output_size = 0;
+	// Where the terminal's cursor and color are, as far as this frame knows.
+	int cursor_row = -1;
+	int cursor_column = -1;
+	int color = -1;
+	char text[32];
+
+	for (int row=0; row<tr->rows; row++) {
+		for (int column=0; column<tr->columns; column++) {
+			int i = row * tr->columns + column;
+			TermCell cell = tr->back[i];
+			if (cell.character == tr->front[i].character && cell.color == tr->front[i].color) {
+				continue;
+			}
+			if (row != cursor_row || column != cursor_column) {
+				int length = snprintf(text, sizeof(text), "\x1b[%i;%iH", row + 1, column + 1);
+				append(tr, text, length);
+			}
+			if (cell.color != color) {
+				append(tr, BACKGROUNDS[cell.color], strlen(BACKGROUNDS[cell.color]));
+				color = cell.color;
+			}
+			append(tr, &cell.character, 1);
+			cursor_row = row;
+			cursor_column = column + 1;
+			tr->front[i] = cell;
+		}
+	}
+	if (tr->output_size == 0) {
+		return 0;
+	}
+	if (color != 0) {
+		append(tr, BACKGROUNDS[0], strlen(BACKGROUNDS[0]));
+	}
+	fwrite(tr->output, 1, tr->output_size, out);
+	fflush(out);
+	return tr->output_size;
+}
@@ -0,0 +1,45 @@
+/**
+ * Draws boards on an ANSI terminal, tiled side by side.
+ *
+ * Boards are drawn into an off-screen grid of character cells. Flushing
+ * compares it with what was last sent and writes only the cursor moves,
+ * colors and characters that changed, in one write per frame.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "pieces.h"
+
+#ifndef TERM_RENDER_H
+#define TERM_RENDER_H
+
+/* Each block is two characters wide, so blocks look square. */
+#define TERM_TILE_WIDTH (2 * WIDTH + 3)
+/* A label line above the board and a border below it. */
+#define TERM_TILE_HEIGHT (HEIGHT + 2)
+
+typedef struct {
+	char character;
+	/* Background color, as a PALETTE index; 0 is the terminal's default. */
+	uint8_t color;
+} TermCell ;
+
+typedef struct {
+	int tiles_across;
+	int tiles_down;
+	int columns;
+	int rows;
+	/* What the terminal shows now, and the frame being drawn. */
+	TermCell * front;
+	TermCell * back;
+	char * output;
+	size_t output_size;
+	size_t output_capacity;
+} TermRenderer ;
+
+TermRenderer * term_renderer_create(int tiles_across, int tiles_down);
+void term_renderer_free(TermRenderer * tr);
+void term_renderer_draw_board(TermRenderer * tr, int tile, Board * b, const char * label);
+size_t term_renderer_flush(TermRenderer * tr, FILE * out);
+
+#endif /* TERM_RENDER_H */
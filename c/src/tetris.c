@@ -2,11 +2,14 @@
 #include <gdk/gdkdrawable.h>
 #include <gdk/gdkkeysyms.h>
 #include <stdlib.h>
-#include <pthread.h>
 #include "pieces.h"
 #include <stdio.h>
 
 #define BLOCK_SIZE 30
+/* How often the board is repainted, if anything changed; about once per display frame. */
+#define FRAME_MS 16
+/* How often the piece falls a row on its own. */
+#define GRAVITY_MS 1000
 
 typedef struct _components {
 	Board *board;
@@ -18,6 +21,20 @@ typedef struct _components {
 
 static components this;
 
+/* Set when the board changes; the next frame repaints and clears it. */
+static volatile gint dirty = 1;
+
+/* PALETTE entries parsed once, indexed like PALETTE. */
+static GdkColor palette_colors[PALETTE_SIZE];
+static GdkColor white;
+
+static void resolve_palette() {
+	for (int i=1; i<PALETTE_SIZE; i++) {
+		gdk_color_parse (PALETTE[i], &palette_colors[i]);
+	}
+	gdk_color_parse ("#FFFFFF", &white);
+}
+
 static void createWindow() {
 	this.board = board_create();
     this.window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
@@ -41,36 +58,28 @@ static void show() {
     gtk_widget_show (this.window);
 }
 
-/* Draw a rectangle on the screen */
+/* Draw a rectangle on the screen in the given PALETTE color */
 static void
-draw_block (GtkWidget *widget, Point * p)
+draw_block (GtkWidget *widget, int x, int y, int color)
 {
 	GdkRectangle update_rect;
-	update_rect.x = p->x*BLOCK_SIZE;
-	update_rect.y = p->y*BLOCK_SIZE;
+	update_rect.x = x*BLOCK_SIZE;
+	update_rect.y = y*BLOCK_SIZE;
 	update_rect.width = BLOCK_SIZE;
 	update_rect.height = BLOCK_SIZE;
 
-	//	GdkColormap * cmap = gdk_colormap_get_system();
-	GdkColor * color = malloc(sizeof(GdkColor));
-	gdk_color_parse (p->color, color);
-
-	GdkColor * white = malloc(sizeof(GdkColor));
-	gdk_color_parse ("#FFFFFF", white);
-
-
 	GdkGC *gc = widget->style->white_gc;
 	//	gdk_gc_set_background(gc, &color);
 	//	gdk_gc_set_foreground(gc, color);
 
-	gdk_gc_set_rgb_fg_color (gc, color);
+	gdk_gc_set_rgb_fg_color (gc, &palette_colors[color]);
 	gdk_draw_rectangle (this.pixMap,
 						gc,
 						TRUE,
 						update_rect.x, update_rect.y,
 						update_rect.width, update_rect.height);
 
-	gdk_gc_set_rgb_fg_color (gc, white);
+	gdk_gc_set_rgb_fg_color (gc, &white);
 	gdk_draw_rectangle (this.pixMap,
 						widget->style->black_gc,	
 						FALSE,
@@ -83,11 +92,8 @@ draw_piece (GtkWidget *widget, Piece * p)
 {
 	for (int i=0; i<4; i++){
 		Point * relative_point = p->blocks[i];
-		Point * real_point = point_create(relative_point->x + p->center->x,
-										  relative_point->y + p->center->y);
-		real_point->color = relative_point->color;
-		draw_block(widget, real_point);
-		point_free(real_point);
+		draw_block(widget, relative_point->x + p->center->x,
+				   relative_point->y + p->center->y, p->color);
 	}
 }
 
@@ -118,8 +124,9 @@ board_redraw(GtkWidget *widget, Board * b)
 	draw_piece(widget, b->current_piece);
 	for (int x=0; x<b->width; x++){
 		for (int y=0; y<b->height; y++){
-			if (b->placed_blocks[x][y] != NULL){
-				draw_block(widget, board_find_piece_at(this.board, x, y));
+			int color = board_cell(b, x, y);
+			if (color != 0){
+				draw_block(widget, x, y, color);
 			}
 		}
 	}
@@ -133,6 +140,26 @@ board_redraw(GtkWidget *widget, Board * b)
 								widget->allocation.width, widget->allocation.height);
 }
 
+/* 
+ * Ask for the board to be repainted. Safe from any thread; however many
+ * times it's called between frames, the board is only drawn once.
+ */
+static void
+mark_dirty()
+{
+	g_atomic_int_set(&dirty, 1);
+}
+
+/* Runs once per frame on the main loop, redrawing the board if it changed */
+static gboolean
+frame_tick(gpointer data)
+{
+	if (this.pixMap != NULL && g_atomic_int_compare_and_exchange(&dirty, 1, 0)) {
+		board_redraw(this.drawingArea, this.board);
+	}
+	return TRUE;
+}
+
 /* Create a new backing pixmap of the appropriate size */
 static gboolean
 configure_event( GtkWidget *widget, GdkEventConfigure *event )
@@ -151,6 +178,7 @@ configure_event( GtkWidget *widget, GdkEventConfigure *event )
 						0, 0,
 						widget->allocation.width,
 						widget->allocation.height);
+	mark_dirty();
 	return TRUE;
 }
 
@@ -186,7 +214,7 @@ key_press_event( GtkWidget *widget, GdkEventKey *event, gpointer func_data )
 		handled = FALSE;
 	}
 	if (handled){
-		board_redraw(widget, this.board);
+		mark_dirty();
 	}
 	return handled;
 }
@@ -205,27 +233,33 @@ static void createDrawingArea() {
 						   | GDK_KEY_PRESS_MASK);
 }
 
-void *push_piece_down_thread()
+/* 
+ * Runs once a second on the main loop, moving the piece down a row. Being
+ * on the main loop keeps it from touching the board while a key press or
+ * a redraw is using it. Stops once the game is over.
+ */
+static gboolean
+gravity_tick(gpointer data)
 {
-	while(!this.board->is_done){
-		sleep(1);
-		board_push_current_piece_down(this.board);
-		board_redraw(this.window, this.board);
+	if (this.board->is_done) {
+		return FALSE;
 	}
+	board_push_current_piece_down(this.board);
+	mark_dirty();
+	return TRUE;
 }
 
 int main( int argc, char *argv[] )
 {
 	srand(time(NULL));
     gtk_init (&argc, &argv);
+    resolve_palette();
     createWindow();
     createDrawingArea();
     layoutWidgets();
     show();
-	board_redraw(this.drawingArea, this.board);
-	
-	pthread_t thread1;
-	int return1 = pthread_create( &thread1, NULL, push_piece_down_thread, NULL);
+	g_timeout_add(FRAME_MS, frame_tick, NULL);
+	g_timeout_add(GRAVITY_MS, gravity_tick, NULL);
 
     gtk_main ();
     return 0;
@@ -0,0 +1,203 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "pieces.h"
+#include "ai.h"
+#include "versus.h"
+
+/**
+ * tetris-tournament: play every bot against every other bot in versus
+ * matches, on all cores, and rate them with Elo.
+ *
+ * Bots are read from a file, one per line: a name followed by the AI
+ * weights, as printed by tetris-tuner.
+ */
+
+#define MAX_BOTS 256
+#define ELO_START 1500.0
+#define ELO_K 16.0
+
+typedef struct {
+	char name[64];
+	AiWeights weights;
+	double rating;
+	int wins;
+	int losses;
+	int draws;
+} Bot ;
+
+/** One match; which bots play, and who won once it has been played. */
+typedef struct {
+	int players[2];
+	unsigned int seed;
+	int winner;
+} Match ;
+
+typedef struct {
+	Bot * bots;
+	Match * matches;
+	int match_count;
+	int next_match;
+	int max_turns;
+	pthread_mutex_t lock;
+} Tournament ;
+
+static int read_bots(const char * path, Bot * bots)
+{
+	FILE * file = fopen(path, "r");
+	if (file == NULL) {
+		return -1;
+	}
+	int count = 0;
+	char line[512];
+	while (count < MAX_BOTS && fgets(line, sizeof(line), file) != NULL) {
+		Bot * bot = &bots[count];
+		memset(bot, 0, sizeof(Bot));
+		double * w = bot->weights.weights;
+		if (sscanf(line, "%63s %lf %lf %lf %lf", bot->name, &w[0], &w[1], &w[2], &w[3]) == 1 + AI_FEATURE_COUNT &&
+			bot->name[0] != '#') {
+			bot->rating = ELO_START;
+			count++;
+		}
+	}
+	fclose(file);
+	return count;
+}
+
+static void * worker_run(void * arg)
+{
+	Tournament * t = arg;
+	for (;;) {
+		pthread_mutex_lock(&t->lock);
+		int i = t->next_match++;
+		pthread_mutex_unlock(&t->lock);
+		if (i >= t->match_count) {
+			return NULL;
+		}
+		Match * m = &t->matches[i];
+		VersusMatch * match = versus_create(m->seed);
+		m->winner = versus_play(match, &t->bots[m->players[0]].weights,
+								&t->bots[m->players[1]].weights, t->max_turns);
+		versus_free(match);
+	}
+}
+
+/** 
+ * Update ratings from the results, in the order matches were scheduled,
+ * so the ratings don't depend on which thread finished first.
+ */
+static void rate(Tournament * t)
+{
+	for (int i=0; i<t->match_count; i++) {
+		Match * m = &t->matches[i];
+		Bot * a = &t->bots[m->players[0]];
+		Bot * b = &t->bots[m->players[1]];
+		double expected = 1 / (1 + pow(10, (b->rating - a->rating) / 400));
+		double result = 0.5;
+		if (m->winner == 0) {
+			result = 1;
+			a->wins++;
+			b->losses++;
+		} else if (m->winner == 1) {
+			result = 0;
+			a->losses++;
+			b->wins++;
+		} else {
+			a->draws++;
+			b->draws++;
+		}
+		a->rating += ELO_K * (result - expected);
+		b->rating -= ELO_K * (result - expected);
+	}
+}
+
+static int compare_ratings(const void * a, const void * b)
+{
+	double r1 = ((const Bot *) a)->rating;
+	double r2 = ((const Bot *) b)->rating;
+	return (r1 < r2) - (r1 > r2);
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: tetris-tournament [-m matches] [-p turns] [-t threads] [-s seed] bots_file\n"
+			"  -m n  matches per pair of bots (default 10)\n"
+			"  -p n  turns before a match is decided on score (default 1000)\n"
+			"  -t n  threads (default: all cores)\n"
+			"  -s n  seed (default 1)\n");
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	int matches_per_pair = 10;
+	int max_turns = 1000;
+	int thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int seed = 1;
+	int opt;
+	while ((opt = getopt(argc, argv, "m:p:t:s:")) != -1) {
+		switch (opt) {
+		case 'm': matches_per_pair = atoi(optarg); break;
+		case 'p': max_turns = atoi(optarg); break;
+		case 't': thread_count = atoi(optarg); break;
+		case 's': seed = strtoul(optarg, NULL, 10); break;
+		default: usage();
+		}
+	}
+	if (argc - optind != 1 || matches_per_pair < 1 || max_turns < 1 || thread_count < 1) {
+		usage();
+	}
+
+	Tournament t;
+	t.bots = malloc(sizeof(Bot) * MAX_BOTS);
+	int bot_count = read_bots(argv[optind], t.bots);
+	if (bot_count < 2) {
+		fprintf(stderr, "Need at least 2 bots in %s\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	// Round robin; every pair plays each seed twice, swapping who moves first.
+	t.match_count = bot_count * (bot_count - 1) / 2 * matches_per_pair * 2;
+	t.matches = malloc(sizeof(Match) * t.match_count);
+	int m = 0;
+	for (int k=0; k<matches_per_pair; k++) {
+		unsigned int match_seed = seed + k * 7919u;
+		for (int i=0; i<bot_count; i++) {
+			for (int j=i+1; j<bot_count; j++) {
+				t.matches[m++] = (Match) {{i, j}, match_seed, VERSUS_DRAW};
+				t.matches[m++] = (Match) {{j, i}, match_seed, VERSUS_DRAW};
+			}
+		}
+	}
+	t.next_match = 0;
+	t.max_turns = max_turns;
+	pthread_mutex_init(&t.lock, NULL);
+
+	pthread_t * threads = malloc(sizeof(pthread_t) * thread_count);
+	for (int i=0; i<thread_count; i++) {
+		pthread_create(&threads[i], NULL, worker_run, &t);
+	}
+	for (int i=0; i<thread_count; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	rate(&t);
+	qsort(t.bots, bot_count, sizeof(Bot), compare_ratings);
+	printf("%-24s %7s %6s %6s %6s\n", "bot", "elo", "won", "lost", "drawn");
+	for (int i=0; i<bot_count; i++) {
+		Bot * bot = &t.bots[i];
+		printf("%-24s %7.1f %6i %6i %6i\n", bot->name, bot->rating, bot->wins, bot->losses, bot->draws);
+	}
+
+	free(threads);
+	free(t.matches);
+	free(t.bots);
+	pthread_mutex_destroy(&t.lock);
+	return EXIT_SUCCESS;
+}
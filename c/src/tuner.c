@@ -0,0 +1,377 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "pieces.h"
+#include "ai.h"
+
+/**
+ * tetris-tuner: tune the AI's feature weights with the noisy cross-entropy
+ * method.
+ *
+ * Every candidate plays the same games (the same piece seeds), so
+ * differences between candidates come from the weights and not from luck.
+ * Games are played in rounds; after each round, candidates far behind the
+ * current elite are dropped instead of playing the rest of their games.
+ */
+
+#define MAX_POPULATION 1024
+#define MAX_GAMES 1024
+#define ROUNDS 4
+/* A candidate is dropped when its average falls below this fraction of the elite cut-off. */
+#define PRUNE_FRACTION 0.5
+/* Extra variance added each generation, decaying, so the search doesn't collapse early. */
+#define NOISE 0.1
+#define PI 3.14159265358979323846
+
+typedef struct {
+	int generations;
+	int population;
+	int elite;
+	int games;
+	int max_pieces;
+	int thread_count;
+	unsigned int seed;
+	const char * checkpoint;
+} Options ;
+
+typedef struct {
+	AiWeights weights;
+	double total;
+	int played;
+	bool alive;
+} Candidate ;
+
+/** The games to play in one round, handed out to workers one at a time. */
+typedef struct {
+	Options * options;
+	Candidate * candidates;
+	unsigned int * seeds;
+	int first_game;
+	int last_game;
+	int next_job;
+	int job_count;
+	int * job_candidates;
+	pthread_mutex_t lock;
+} Round ;
+
+/** The search distribution; what a checkpoint stores. */
+typedef struct {
+	int generation;
+	double mean[AI_FEATURE_COUNT];
+	double stddev[AI_FEATURE_COUNT];
+	double best_score;
+	AiWeights best;
+} Search ;
+
+static unsigned int next_random(unsigned int * state)
+{
+	// Numerical Recipes LCG
+	*state = *state * 1664525u + 1013904223u;
+	return *state;
+}
+
+static double uniform(unsigned int * state)
+{
+	return (next_random(state) >> 8) / (double) (1u << 24);
+}
+
+/** Box-Muller transform. */
+static double gaussian(unsigned int * state)
+{
+	double u = uniform(state);
+	double v = uniform(state);
+	return sqrt(-2 * log(u + 1e-12)) * cos(2 * PI * v);
+}
+
+static double average(const Candidate * c)
+{
+	return c->played > 0 ? c->total / c->played : 0;
+}
+
+static void * worker_run(void * arg)
+{
+	Round * round = arg;
+	int games_per_candidate = round->last_game - round->first_game;
+	for (;;) {
+		pthread_mutex_lock(&round->lock);
+		int job = round->next_job++;
+		pthread_mutex_unlock(&round->lock);
+		if (job >= round->job_count) {
+			return NULL;
+		}
+		Candidate * c = &round->candidates[round->job_candidates[job / games_per_candidate]];
+		int game = round->first_game + job % games_per_candidate;
+
+		Board * b = board_create_seeded(round->seeds[game]);
+		ai_play_game(b, &c->weights, round->options->max_pieces);
+		pthread_mutex_lock(&round->lock);
+		c->total += b->score;
+		c->played++;
+		pthread_mutex_unlock(&round->lock);
+		board_free(b);
+	}
+}
+
+/** Play games [first_game, last_game) for every candidate still alive. */
+static void play_round(Options * o, Candidate * candidates, unsigned int * seeds,
+					   int first_game, int last_game)
+{
+	Round round;
+	round.options = o;
+	round.candidates = candidates;
+	round.seeds = seeds;
+	round.first_game = first_game;
+	round.last_game = last_game;
+	round.next_job = 0;
+	round.job_candidates = malloc(sizeof(int) * o->population);
+	int alive = 0;
+	for (int i=0; i<o->population; i++) {
+		if (candidates[i].alive) {
+			round.job_candidates[alive++] = i;
+		}
+	}
+	round.job_count = alive * (last_game - first_game);
+	pthread_mutex_init(&round.lock, NULL);
+
+	pthread_t * threads = malloc(sizeof(pthread_t) * o->thread_count);
+	for (int i=0; i<o->thread_count; i++) {
+		pthread_create(&threads[i], NULL, worker_run, &round);
+	}
+	for (int i=0; i<o->thread_count; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	free(round.job_candidates);
+	pthread_mutex_destroy(&round.lock);
+}
+
+static int compare_averages(const void * a, const void * b)
+{
+	const Candidate * c1 = *(Candidate * const *) a;
+	const Candidate * c2 = *(Candidate * const *) b;
+	double a1 = c1->alive ? average(c1) : -1;
+	double a2 = c2->alive ? average(c2) : -1;
+	return (a1 < a2) - (a1 > a2);
+}
+
+/** Sort candidates best first; dropped candidates go last. */
+static void rank(Options * o, Candidate * candidates, Candidate ** ranked)
+{
+	for (int i=0; i<o->population; i++) {
+		ranked[i] = &candidates[i];
+	}
+	qsort(ranked, o->population, sizeof(Candidate *), compare_averages);
+}
+
+/** Drop candidates that are clearly worse than the current elite. */
+static void prune(Options * o, Candidate * candidates)
+{
+	Candidate * ranked[MAX_POPULATION];
+	rank(o, candidates, ranked);
+	double cut_off = average(ranked[o->elite - 1]);
+	for (int i=o->elite; i<o->population; i++) {
+		if (average(ranked[i]) < cut_off * PRUNE_FRACTION) {
+			ranked[i]->alive = false;
+		}
+	}
+}
+
+static bool save_checkpoint(const char * path, Search * s)
+{
+	char temp_path[4096];
+	snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+	FILE * file = fopen(temp_path, "w");
+	if (file == NULL) {
+		return false;
+	}
+	fprintf(file, "generation %i\nmean", s->generation);
+	for (int i=0; i<AI_FEATURE_COUNT; i++) {
+		fprintf(file, " %.17g", s->mean[i]);
+	}
+	fprintf(file, "\nstddev");
+	for (int i=0; i<AI_FEATURE_COUNT; i++) {
+		fprintf(file, " %.17g", s->stddev[i]);
+	}
+	fprintf(file, "\nbest %.17g", s->best_score);
+	for (int i=0; i<AI_FEATURE_COUNT; i++) {
+		fprintf(file, " %.17g", s->best.weights[i]);
+	}
+	fprintf(file, "\n");
+	bool ok = fclose(file) == 0;
+	// Replace the old checkpoint only once the new one is complete.
+	return ok && rename(temp_path, path) == 0;
+}
+
+/** 
+ * Read the next word and check it is label. A literal in an fscanf format
+ * can't do this: a mismatch doesn't change the count fscanf returns.
+ */
+static bool read_label(FILE * file, const char * label)
+{
+	char word[16];
+	return fscanf(file, "%15s", word) == 1 && strcmp(word, label) == 0;
+}
+
+/** Resume from a checkpoint. s is left alone unless the whole file reads. */
+static bool load_checkpoint(const char * path, Search * s)
+{
+	FILE * file = fopen(path, "r");
+	if (file == NULL) {
+		return false;
+	}
+	Search loaded = *s;
+	bool ok = read_label(file, "generation") && fscanf(file, "%i", &loaded.generation) == 1 &&
+		read_label(file, "mean");
+	for (int i=0; ok && i<AI_FEATURE_COUNT; i++) {
+		ok = fscanf(file, "%lf", &loaded.mean[i]) == 1;
+	}
+	ok = ok && read_label(file, "stddev");
+	for (int i=0; ok && i<AI_FEATURE_COUNT; i++) {
+		ok = fscanf(file, "%lf", &loaded.stddev[i]) == 1;
+	}
+	ok = ok && read_label(file, "best") && fscanf(file, "%lf", &loaded.best_score) == 1;
+	for (int i=0; ok && i<AI_FEATURE_COUNT; i++) {
+		ok = fscanf(file, "%lf", &loaded.best.weights[i]) == 1;
+	}
+	fclose(file);
+	if (ok) {
+		*s = loaded;
+	}
+	return ok;
+}
+
+/** Draw a candidate from the search distribution, scaled to unit length. */
+static void sample(Search * s, unsigned int * rng, AiWeights * w)
+{
+	double length = 0;
+	for (int i=0; i<AI_FEATURE_COUNT; i++) {
+		w->weights[i] = s->mean[i] + s->stddev[i] * gaussian(rng);
+		length += w->weights[i] * w->weights[i];
+	}
+	length = sqrt(length);
+	for (int i=0; i<AI_FEATURE_COUNT; i++) {
+		w->weights[i] = length > 0 ? w->weights[i] / length : 0;
+	}
+}
+
+static void run_generation(Options * o, Search * s, Candidate * candidates)
+{
+	// Seeds depend on the generation, so resuming replays the same games.
+	unsigned int rng = o->seed ^ (s->generation * 2654435761u);
+	unsigned int seeds[MAX_GAMES];
+	for (int g=0; g<o->games; g++) {
+		seeds[g] = next_random(&rng);
+	}
+	for (int i=0; i<o->population; i++) {
+		sample(s, &rng, &candidates[i].weights);
+		candidates[i].total = 0;
+		candidates[i].played = 0;
+		candidates[i].alive = true;
+	}
+
+	for (int r=0; r<ROUNDS; r++) {
+		play_round(o, candidates, seeds, o->games * r / ROUNDS, o->games * (r + 1) / ROUNDS);
+		if (r < ROUNDS - 1) {
+			prune(o, candidates);
+		}
+	}
+
+	Candidate * ranked[MAX_POPULATION];
+	rank(o, candidates, ranked);
+	for (int i=0; i<AI_FEATURE_COUNT; i++) {
+		double mean = 0;
+		for (int e=0; e<o->elite; e++) {
+			mean += ranked[e]->weights.weights[i];
+		}
+		mean /= o->elite;
+		double variance = 0;
+		for (int e=0; e<o->elite; e++) {
+			double d = ranked[e]->weights.weights[i] - mean;
+			variance += d * d;
+		}
+		variance /= o->elite;
+		s->mean[i] = mean;
+		s->stddev[i] = sqrt(variance + NOISE / (s->generation + 1));
+	}
+	if (average(ranked[0]) > s->best_score) {
+		s->best_score = average(ranked[0]);
+		s->best = ranked[0]->weights;
+	}
+
+	int survivors = 0;
+	for (int i=0; i<o->population; i++) {
+		survivors += candidates[i].alive;
+	}
+	printf("generation %i: best %.1f, elite cut-off %.1f, %i/%i played every game\n",
+		   s->generation, average(ranked[0]), average(ranked[o->elite - 1]),
+		   survivors, o->population);
+	s->generation++;
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: tetris-tuner [options]\n"
+			"  -g n     generations to run (default 50)\n"
+			"  -n n     candidates per generation (default 40)\n"
+			"  -e n     elite candidates kept (default 10)\n"
+			"  -m n     games per candidate (default 20)\n"
+			"  -p n     piece limit per game (default 500)\n"
+			"  -t n     threads (default: all cores)\n"
+			"  -s n     seed (default 1)\n"
+			"  -c file  checkpoint file, resumed from if it exists\n");
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	Options o = {50, 40, 10, 20, 500, sysconf(_SC_NPROCESSORS_ONLN), 1, NULL};
+	int opt;
+	while ((opt = getopt(argc, argv, "g:n:e:m:p:t:s:c:")) != -1) {
+		switch (opt) {
+		case 'g': o.generations = atoi(optarg); break;
+		case 'n': o.population = atoi(optarg); break;
+		case 'e': o.elite = atoi(optarg); break;
+		case 'm': o.games = atoi(optarg); break;
+		case 'p': o.max_pieces = atoi(optarg); break;
+		case 't': o.thread_count = atoi(optarg); break;
+		case 's': o.seed = strtoul(optarg, NULL, 10); break;
+		case 'c': o.checkpoint = optarg; break;
+		default: usage();
+		}
+	}
+	if (optind != argc || o.population < 1 || o.population > MAX_POPULATION ||
+		o.elite < 1 || o.elite > o.population || o.games < ROUNDS || o.games > MAX_GAMES ||
+		o.max_pieces < 1 || o.thread_count < 1) {
+		usage();
+	}
+
+	Search s;
+	memset(&s, 0, sizeof(Search));
+	for (int i=0; i<AI_FEATURE_COUNT; i++) {
+		s.stddev[i] = 1;
+	}
+	if (o.checkpoint != NULL && load_checkpoint(o.checkpoint, &s)) {
+		printf("resuming from generation %i\n", s.generation);
+	}
+
+	Candidate * candidates = malloc(sizeof(Candidate) * o.population);
+	while (s.generation < o.generations) {
+		run_generation(&o, &s, candidates);
+		if (o.checkpoint != NULL && !save_checkpoint(o.checkpoint, &s)) {
+			fprintf(stderr, "Couldn't write checkpoint %s\n", o.checkpoint);
+		}
+	}
+	printf("best average %.1f with weights", s.best_score);
+	for (int i=0; i<AI_FEATURE_COUNT; i++) {
+		printf(" %.6f", s.best.weights[i]);
+	}
+	printf("\n");
+	free(candidates);
+	return EXIT_SUCCESS;
+}
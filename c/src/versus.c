@@ -0,0 +1,81 @@
+
+#include <config.h>
+#include <stdlib.h>
+#include "versus.h"
+
+/** How many garbage rows clearing lines rows at once sends. */
+int versus_garbage_for_lines(int lines)
+{
+	static const int GARBAGE[5] = {0, 0, 1, 2, 4};
+	return lines >= 0 && lines <= 4 ? GARBAGE[lines] : 4;
+}
+
+/** Both boards are seeded alike, so both players see the same pieces. */
+VersusMatch * versus_create(unsigned int seed)
+{
+	VersusMatch * match = malloc(sizeof(VersusMatch));
+	match->boards[0] = board_create_seeded(seed);
+	match->boards[1] = board_create_seeded(seed);
+	match->pending[0] = 0;
+	match->pending[1] = 0;
+	match->rng_state = seed ^ 0x5bd1e995u;
+	match->turns = 0;
+	return match;
+}
+
+void versus_free(VersusMatch * match)
+{
+	board_free(match->boards[0]);
+	board_free(match->boards[1]);
+	free(match);
+}
+
+/** 
+ * player cleared lines rows. Garbage waiting for them is cancelled first;
+ * whatever is left over goes to the opponent.
+ */
+void versus_send_lines(VersusMatch * match, int player, int lines)
+{
+	int garbage = versus_garbage_for_lines(lines);
+	int cancelled = garbage < match->pending[player] ? garbage : match->pending[player];
+	match->pending[player] -= cancelled;
+	match->pending[1 - player] += garbage - cancelled;
+}
+
+/** Add the garbage waiting for player to their board. Returns false if that ended their game. */
+bool versus_take_garbage(VersusMatch * match, int player)
+{
+	int rows = match->pending[player];
+	match->pending[player] = 0;
+	match->rng_state = match->rng_state * 1664525u + 1013904223u;
+	int hole_column = (match->rng_state >> 16) % WIDTH;
+	return board_add_garbage(match->boards[player], rows, hole_column);
+}
+
+/**
+ * Let two AIs play the match out, taking turns to lock one piece each.
+ * After max_turns the higher score wins. Returns the winning player, 0 or
+ * 1, or VERSUS_DRAW.
+ */
+int versus_play(VersusMatch * match, const AiWeights * first, const AiWeights * second, int max_turns)
+{
+	const AiWeights * weights[2] = {first, second};
+	while (match->turns < max_turns) {
+		for (int player=0; player<2; player++) {
+			Board * b = match->boards[player];
+			if (!versus_take_garbage(match, player)) {
+				return 1 - player;
+			}
+			int lines = b->lines;
+			ai_play_move(b, weights[player]);
+			if (b->is_done) {
+				return 1 - player;
+			}
+			versus_send_lines(match, player, b->lines - lines);
+		}
+		match->turns++;
+	}
+	int score0 = match->boards[0]->score;
+	int score1 = match->boards[1]->score;
+	return score0 == score1 ? VERSUS_DRAW : (score0 > score1 ? 0 : 1);
+}
@@ -0,0 +1,30 @@
+/**
+ * Two-player matches: both players get the same pieces, and rows one
+ * player clears are sent to the other as garbage.
+ */
+
+#include "pieces.h"
+#include "ai.h"
+
+#ifndef VERSUS_H
+#define VERSUS_H
+
+#define VERSUS_DRAW -1
+
+typedef struct {
+	Board * boards[2];
+	/* Garbage waiting to be added to each player's board. */
+	int pending[2];
+	/* Picks the gap column of each batch of garbage. */
+	unsigned int rng_state;
+	int turns;
+} VersusMatch ;
+
+int versus_garbage_for_lines(int lines);
+VersusMatch * versus_create(unsigned int seed);
+void versus_free(VersusMatch * match);
+void versus_send_lines(VersusMatch * match, int player, int lines);
+bool versus_take_garbage(VersusMatch * match, int player);
+int versus_play(VersusMatch * match, const AiWeights * first, const AiWeights * second, int max_turns);
+
+#endif /* VERSUS_H */
@@ -1,7 +1,21 @@
+#include <config.h>
 #include </usr/include/check.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "../src/pieces.h"
+#include "../src/env.h"
+#include "../src/obs_ring.h"
+#include "../src/movegen.h"
+#include "../src/ai.h"
+#include "../src/surface.h"
+#include "../src/spectate.h"
+#include "../src/term_render.h"
+#include "../src/counters.h"
+#include "../src/versus.h"
+#include "../src/snapshot.h"
+#include "../src/solver.h"
+#include "../src/stats.h"
 
 
 
@@ -87,19 +101,19 @@ START_TEST (piece_test_rotate_clockwise)
 
 	/* Rotate one time. */
 	int blocks[4][2] = {{0,-1}, {0,0}, {0,1}, {-1,1}};
-	Piece * rotate_1_time = piece_create(3, 3, blocks, NULL);
+	Piece * rotate_1_time = piece_create(3, 3, blocks, 0);
 	piece_rotate_clockwise(p1);
 	fail_unless (piece_equals(p1, rotate_1_time), "pieces should be equal after 1 rotation");
 	
 	/* Rotate a second time. */
 	int blocks2[4][2] = {{1,0}, {0,0}, {-1,0}, {-1,-1}};
-	Piece * rotate_2_time = piece_create(3, 3, blocks2, NULL);
+	Piece * rotate_2_time = piece_create(3, 3, blocks2, 0);
 	piece_rotate_clockwise(p1);
 	fail_unless (piece_equals(p1, rotate_2_time), "pieces should be equal after 2 rotations");
 	
 	/* Rotate a third time. */
 	int blocks3[4][2] = {{0,1}, {0,0}, {0,-1}, {1,-1}};
-	Piece * rotate_3_time = piece_create(3, 3, blocks3, NULL);
+	Piece * rotate_3_time = piece_create(3, 3, blocks3, 0);
 	piece_rotate_clockwise(p1);
 	fail_unless (piece_equals(p1, rotate_3_time), "pieces should be equal after 3 rotations");
 
@@ -122,19 +136,19 @@ START_TEST (piece_test_rotate_counter_clockwise)
 
 	/* Rotate one time. */
 	int blocks3[4][2] = {{0,1}, {0,0}, {0,-1}, {1,-1}};
-	Piece * rotate_1_time = piece_create(3, 3, blocks3, NULL);
+	Piece * rotate_1_time = piece_create(3, 3, blocks3, 0);
 	piece_rotate_counter_clockwise(p1);
 	fail_unless (piece_equals(p1, rotate_1_time), "pieces should be equal after 1 rotation");
 
 	/* Rotate a second time. */
 	int blocks2[4][2] = {{1,0}, {0,0}, {-1,0}, {-1,-1}};
-	Piece * rotate_2_time = piece_create(3, 3, blocks2, NULL);
+	Piece * rotate_2_time = piece_create(3, 3, blocks2, 0);
 	piece_rotate_counter_clockwise(p1);
 	fail_unless (piece_equals(p1, rotate_2_time), "pieces should be equal after 2 rotations");
 
 	/* Rotate a third time. */
 	int blocks[4][2] = {{0,-1}, {0,0}, {0,1}, {-1,1}};
-	Piece * rotate_3_time = piece_create(3, 3, blocks, NULL);
+	Piece * rotate_3_time = piece_create(3, 3, blocks, 0);
 	piece_rotate_counter_clockwise(p1);
 	fail_unless (piece_equals(p1, rotate_3_time), "pieces should be equal after 3 rotations");
 
@@ -218,6 +232,556 @@ END_TEST
 
 
 
+START_TEST (seeded_board_test)
+{
+	Board * b1 = board_create_seeded(42);
+	Board * b2 = board_create_seeded(42);
+	for (int i=0; i<200; i++){
+		fail_unless (piece_equals(b1->current_piece, b2->current_piece), "Seeded boards should get the same pieces");
+		board_push_current_piece_down(b1);
+		board_push_current_piece_down(b2);
+	}
+	board_free(b1);
+	board_free(b2);
+}
+END_TEST
+
+START_TEST (env_batch_test)
+{
+	int count = 3;
+	EnvBatch * batch = env_batch_create(count, 7);
+	uint8_t observations[3 * ENV_OBSERVATION_SIZE];
+	float rewards[3];
+	uint8_t dones[3];
+	int32_t actions[3] = {ENV_ACTION_DROP, ENV_ACTION_LEFT, ENV_ACTION_NONE};
+
+	bool saw_done = false;
+	Counters before;
+	counters_read(&before);
+	for (int i=0; i<1000; i++){
+		env_batch_step(batch, actions, observations, rewards, dones);
+		saw_done = saw_done || dones[0];
+	}
+	fail_unless (saw_done, "Dropping every piece in the middle should end the game");
+	Counters after;
+	counters_read(&after);
+	fail_unless (after.values[COUNTER_ALLOCATIONS] == before.values[COUNTER_ALLOCATIONS],
+				 "Stepping, spawning and resetting shouldn't allocate");
+#ifdef TETRIS_COUNTERS
+	fail_unless (after.values[COUNTER_LOCKS] > before.values[COUNTER_LOCKS], "The steps should have been counted");
+#endif
+	for (int i=0; i<count; i++){
+		fail_if (batch->boards[i]->is_done, "Finished games should be reset");
+		int piece_cells = 0;
+		for (int c=0; c<ENV_OBSERVATION_SIZE; c++){
+			piece_cells += observations[i * ENV_OBSERVATION_SIZE + c] == ENV_CELL_PIECE;
+		}
+		fail_unless (piece_cells == 4, "The falling piece should be in the observation");
+	}
+	env_batch_free(batch);
+}
+END_TEST
+
+START_TEST (obs_ring_test)
+{
+	obs_ring_unlink("/tetris_test_ring");
+	ObsRing * writer = obs_ring_create("/tetris_test_ring", 4);
+	fail_if (writer == NULL, "Couldn't create the ring");
+	ObsRing * reader = obs_ring_open("/tetris_test_ring");
+	fail_if (reader == NULL, "Couldn't open the ring");
+
+	ObsFrame frame;
+	fail_unless (obs_ring_read_latest(reader, &frame) == OBS_RING_NOT_READY, "An empty ring has no frames");
+
+	Board * b = board_create_seeded(3);
+	for (int i=0; i<6; i++){
+		b->score = i;
+		obs_ring_publish(writer, b);
+	}
+	fail_unless (obs_ring_head(reader) == 6, "All frames should be counted");
+	fail_unless (obs_ring_read(reader, 0, &frame) == OBS_RING_OVERWRITTEN, "Old frames should be overwritten");
+	fail_unless (obs_ring_read(reader, 6, &frame) == OBS_RING_NOT_READY, "Future frames aren't ready");
+	fail_unless (obs_ring_read(reader, 3, &frame) == OBS_RING_OK, "Recent frames should be readable");
+	fail_unless (frame.score == 3, "The frame should hold the published score");
+	fail_unless (obs_ring_read_latest(reader, &frame) == OBS_RING_OK && frame.index == 5, "Should read the newest frame");
+
+	board_free(b);
+	// Replacing the ring with a smaller one leaves the old mapping readable.
+	ObsRing * replacement = obs_ring_create("/tetris_test_ring", 1);
+	fail_if (replacement == NULL, "Couldn't replace the ring");
+	fail_unless (obs_ring_read(reader, 3, &frame) == OBS_RING_OK && frame.score == 3, 
+				 "Readers of a replaced ring keep their frames");
+	obs_ring_close(reader);
+	replacement->header->slot_count = 0;
+	fail_unless (obs_ring_open("/tetris_test_ring") == NULL, "A ring without slots can't be read");
+	obs_ring_close(replacement);
+	obs_ring_close(writer);
+	obs_ring_unlink("/tetris_test_ring");
+}
+END_TEST
+
+START_TEST (movegen_test)
+{
+	Board * b = board_create_seeded(1);
+	Placement placements[MOVEGEN_MAX_PLACEMENTS];
+
+	Piece * p = square(WIDTH / 2, 2);
+	fail_unless (movegen_find_placements(b, p, placements) == WIDTH - 1, "A square fits in 9 columns");
+	fail_unless (movegen_find_placements_unordered(b, p, placements) == WIDTH - 1, "Rotating a square changes nothing");
+	piece_free(p);
+
+	p = line(WIDTH / 2, 2);
+	fail_unless (movegen_find_placements_unordered(b, p, placements) == WIDTH + WIDTH - 3, "In any order, still 17 lines");
+	fail_unless (movegen_find_placements(b, p, placements) == WIDTH + WIDTH - 3, "10 upright and 7 flat lines");
+	movegen_apply(p, &placements[0]);
+	fail_unless (board_check_valid_placement(b, p), "Placements should be valid");
+	piece_down(p);
+	fail_if (board_check_valid_placement(b, p), "Placements should be resting on something");
+	piece_free(p);
+
+	// The checked search is the reference: same placements, same order.
+	Board * messy = board_create_seeded(8);
+	ai_play_game(messy, &AI_DEFAULT_WEIGHTS, 30);
+	Placement checked[MOVEGEN_MAX_PLACEMENTS];
+	for (int type=0; type<PIECE_TYPE_COUNT; type++) {
+		p = piece_create_type(type, WIDTH / 2, 2);
+		int count = movegen_find_placements(messy, p, placements);
+		fail_unless (count > 0 && movegen_find_placements_checked(messy, p, checked) == count,
+					 "Checking every position finds the same placements");
+		fail_unless (memcmp(placements, checked, sizeof(Placement) * count) == 0,
+					 "Checking every position finds them in the same order");
+		piece_free(p);
+	}
+	board_free(messy);
+
+	Board * copy = board_copy(b);
+	p = line(WIDTH / 2, HEIGHT - 3);
+	board_lock_piece(copy, p);
+	fail_unless (board_cell(copy, WIDTH / 2, HEIGHT - 1) != 0, "The copy should have the piece");
+	fail_unless (board_cell(b, WIDTH / 2, HEIGHT - 1) == 0, "The original should be unchanged");
+	piece_free(p);
+	board_free(copy);
+	board_free(b);
+}
+END_TEST
+
+START_TEST (ai_test)
+{
+	Board * b = board_create_seeded(5);
+	int pieces = ai_play_game(b, &AI_DEFAULT_WEIGHTS, 200);
+	fail_unless (pieces == 200, "The AI should survive 200 pieces");
+	fail_unless (b->score > 0, "The AI should clear some lines");
+	board_free(b);
+}
+END_TEST
+
+START_TEST (surface_test)
+{
+	Board * b = board_create_seeded(1);
+	uint32_t signature;
+	fail_unless (surface_signature(b, 1, &signature), "An empty board is flat");
+	fail_unless (signature == (surface_signature_count(1) - 1) / 2, "A flat board has every step at 0");
+
+	Piece * p = line(0, HEIGHT - 3);
+	board_lock_piece(b, p);
+	piece_free(p);
+	fail_if (surface_signature(b, 2, &signature), "A step of 4 is outside the table");
+	fail_unless (surface_signature(b, 4, &signature), "A step of 4 is inside a larger table");
+
+	int rotation;
+	int x;
+	surface_decode(surface_encode(3, -2), &rotation, &x);
+	fail_unless (rotation == 3 && x == -2, "Entries should decode to what was encoded");
+
+	Placement placement;
+	p = square(WIDTH / 2, 2);
+	fail_unless (movegen_drop(b, p, 0, 0, &placement), "The square can slide over the line");
+	fail_unless (placement.x == 0 && placement.y == HEIGHT - 6, "The square lands on top of the line");
+	piece_free(p);
+	board_free(b);
+
+	// Steps past SURFACE_MAX_STEP are refused; at 6 the signature count, 13^9, doesn't even fit 32 bits.
+	SurfaceTableHeader header = {
+		SURFACE_MAGIC, SURFACE_VERSION, WIDTH, 6, PIECE_TYPE_COUNT, surface_signature_count(6)
+	};
+	FILE * file = fopen("surface_test.tbl", "wb");
+	fwrite(&header, sizeof(header), 1, file);
+	fclose(file);
+	fail_unless (surface_table_open("surface_test.tbl") == NULL, "Steps past SURFACE_MAX_STEP should be refused");
+	remove("surface_test.tbl");
+}
+END_TEST
+
+/** Read everything the viewer hasn't seen into the view. False if a record was split. */
+static bool spectate_catch_up(SpectateHub * hub, SpectateViewer * viewer, SpectateView * view)
+{
+	uint8_t buffer[256];
+	size_t length;
+	while ((length = spectate_hub_read(hub, viewer, buffer, sizeof(buffer))) > 0) {
+		if (spectate_view_apply(view, buffer, length) != length) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool spectate_view_matches(SpectateView * view, Board * b)
+{
+	for (int y=0; y<HEIGHT; y++) {
+		for (int x=0; x<WIDTH; x++) {
+			if (view->cells[y][x] != board_cell(b, x, y)) {
+				return false;
+			}
+		}
+	}
+	return view->score == b->score && view->piece_type == b->current_piece->type;
+}
+
+START_TEST (spectate_test)
+{
+	Board * b = board_create_seeded(9);
+	SpectateHub * hub = spectate_hub_create(4096);
+	SpectateEncoder * encoder = spectate_encoder_create(hub, b, 8);
+
+	SpectateViewer early;
+	SpectateView early_view;
+	spectate_viewer_init(&early);
+	spectate_view_init(&early_view);
+
+	for (int i=0; i<300; i++){
+		ai_play_move(b, &AI_DEFAULT_WEIGHTS);
+		spectate_encoder_update(encoder);
+		if (i % 10 == 0){
+			fail_unless (spectate_catch_up(hub, &early, &early_view), "The hub only hands out whole records");
+			fail_unless (spectate_view_matches(&early_view, b), "A viewer that keeps up should see the board");
+		}
+	}
+	fail_unless (b->score > 0, "The game should have cleared lines");
+
+	SpectateViewer late;
+	SpectateView late_view;
+	spectate_viewer_init(&late);
+	spectate_view_init(&late_view);
+	fail_unless (spectate_catch_up(hub, &late, &late_view), "The hub only hands out whole records");
+	fail_unless (spectate_view_matches(&late_view, b), "A viewer joining late should start from a keyframe");
+
+	spectate_encoder_free(encoder);
+	spectate_hub_free(hub);
+
+	// In the smallest hub one piece's moves are enough to wrap the ring many times.
+	hub = spectate_hub_create(0);
+	encoder = spectate_encoder_create(hub, b, 1000);
+	spectate_viewer_init(&early);
+	spectate_view_init(&early_view);
+	fail_unless (spectate_catch_up(hub, &early, &early_view), "The hub only hands out whole records");
+	for (int i=0; i<(int) hub->capacity; i++){
+		board_try_move(b, i % 2 ? piece_left : piece_right, i % 2 ? piece_right : piece_left);
+		spectate_encoder_update(encoder);
+	}
+	fail_unless (spectate_catch_up(hub, &early, &early_view), "A viewer that fell behind skips to a keyframe");
+	fail_unless (spectate_view_matches(&early_view, b), "A viewer that fell behind skips to a keyframe");
+	fail_unless (early_view.piece_x == b->current_piece->center->x, "The keyframe comes with the piece in play");
+	spectate_viewer_init(&late);
+	spectate_view_init(&late_view);
+	fail_unless (spectate_catch_up(hub, &late, &late_view), "The hub only hands out whole records");
+	fail_unless (spectate_view_matches(&late_view, b), "A viewer joining late should start from a keyframe");
+
+	spectate_encoder_free(encoder);
+	spectate_hub_free(hub);
+	board_free(b);
+}
+END_TEST
+
+START_TEST (term_render_test)
+{
+	FILE * out = tmpfile();
+	TermRenderer * tr = term_renderer_create(2, 1);
+	Board * b1 = board_create_seeded(1);
+	Board * b2 = board_create_seeded(2);
+
+	term_renderer_draw_board(tr, 0, b1, "one");
+	term_renderer_draw_board(tr, 1, b2, "two");
+	size_t full = term_renderer_flush(tr, out);
+	fail_unless (full > 0, "The first frame should draw everything");
+
+	term_renderer_draw_board(tr, 0, b1, "one");
+	term_renderer_draw_board(tr, 1, b2, "two");
+	fail_unless (term_renderer_flush(tr, out) == 0, "Nothing changed, so nothing should be sent");
+
+	board_push_current_piece_down(b1);
+	term_renderer_draw_board(tr, 0, b1, "one");
+	term_renderer_draw_board(tr, 1, b2, "two");
+	size_t moved = term_renderer_flush(tr, out);
+	fail_unless (moved > 0 && moved < full / 10, "Moving a piece should only send the cells it changed");
+
+	board_free(b1);
+	board_free(b2);
+	term_renderer_free(tr);
+	fclose(out);
+}
+END_TEST
+
+START_TEST (counters_test)
+{
+	counters_reset();
+	Board * b = board_create_seeded(4);
+	ai_play_game(b, &AI_DEFAULT_WEIGHTS, 50);
+	// A loaded board can have more rows complete than one piece could fill.
+	board_reset(b, 4);
+	for (int y=HEIGHT - 6; y<HEIGHT; y++) {
+		for (int x=0; x<WIDTH; x++) {
+			board_set_cell(b, x, y, PALETTE_SIZE - 1);
+		}
+	}
+	Piece * p = square(0, 0);
+	fail_unless (board_lock_piece(b, p) == 6, "All six full rows clear");
+	piece_free(p);
+	board_free(b);
+
+	Counters totals;
+	counters_read(&totals);
+#ifdef TETRIS_COUNTERS
+	fail_unless (totals.values[COUNTER_LOCKS] == 51, "Every lock should be counted");
+	fail_unless (totals.values[COUNTER_VALID_PLACEMENT_CHECKS] > 50, "Placement checks should be counted");
+	fail_unless (totals.values[COUNTER_CLEARS_4] >= 1, "Clears past 4 rows count with tetrises");
+#else
+	fail_unless (totals.values[COUNTER_LOCKS] == 0, "Counters are compiled out");
+#endif
+}
+END_TEST
+
+START_TEST (garbage_test)
+{
+	Board * b = board_create_seeded(6);
+	Piece * p = square(0, HEIGHT - 2);
+	board_lock_piece(b, p);
+	piece_free(p);
+
+	fail_unless (board_add_garbage(b, 2, 3), "Two rows of garbage fit");
+	fail_unless (board_cell(b, 0, HEIGHT - 3) != 0, "Blocks should be pushed up");
+	fail_unless (board_cell(b, 0, HEIGHT - 3) == PIECE_SQUARE + 1, "Pushed blocks should keep their color");
+	fail_unless (board_cell(b, 3, HEIGHT - 1) == 0, "The hole should be left open");
+	fail_unless (board_cell(b, 4, HEIGHT - 1) == PALETTE_SIZE - 1, "Garbage fills the rest of the row");
+
+	fail_if (board_add_garbage(b, HEIGHT - 3, 3), "Pushing blocks off the top ends the game");
+	fail_unless (b->is_done, "The game should be over");
+	board_free(b);
+
+	b = board_create_seeded(6);
+	board_add_garbage(b, 1, -4);
+	board_add_garbage(b, 1, WIDTH + 2);
+	fail_unless (board_cell(b, 0, HEIGHT - 2) == 0 && board_cell(b, WIDTH - 1, HEIGHT - 1) == 0, 
+				 "Holes off the board are clamped to its edges");
+	fail_if (board_is_row_complete(b, HEIGHT - 1) || board_is_row_complete(b, HEIGHT - 2), 
+			 "Garbage rows always have a hole");
+	board_free(b);
+
+	fail_unless (versus_garbage_for_lines(1) == 0 && versus_garbage_for_lines(4) == 4, "Tetrises send 4 rows");
+	VersusMatch * match = versus_create(11);
+	fail_unless (piece_equals(match->boards[0]->current_piece, match->boards[1]->current_piece),
+				 "Both players get the same pieces");
+	match->pending[0] = 1;
+	versus_send_lines(match, 0, 3);
+	fail_unless (match->pending[0] == 0 && match->pending[1] == 1, "Clears cancel garbage before sending it");
+	versus_free(match);
+}
+END_TEST
+
+START_TEST (snapshot_test)
+{
+	Board * original = board_create_seeded(12);
+	ai_play_game(original, &AI_DEFAULT_WEIGHTS, 60);
+	piece_rotate_clockwise(original->current_piece);
+
+	BoardImage image;
+	board_save(original, &image);
+	Board * restored = board_create_seeded(99);
+	ai_play_game(restored, &AI_DEFAULT_WEIGHTS, 30);
+	fail_unless (board_restore(restored, &image), "The image should restore");
+	fail_unless (piece_equals(original->current_piece, restored->current_piece), "The current piece should be restored");
+
+	piece_rotate_counter_clockwise(original->current_piece);
+	piece_rotate_counter_clockwise(restored->current_piece);
+	ai_play_game(original, &AI_DEFAULT_WEIGHTS, 100);
+	ai_play_game(restored, &AI_DEFAULT_WEIGHTS, 100);
+	fail_unless (original->score == restored->score, "Restored games should carry on identically");
+	for (int x=0; x<WIDTH; x++){
+		for (int y=0; y<HEIGHT; y++){
+			fail_unless (board_cell(original, x, y) == board_cell(restored, x, y),
+						 "Restored games should carry on identically");
+		}
+	}
+
+	image.version++;
+	fail_if (board_restore(restored, &image), "Images from other versions are rejected");
+	image.version--;
+
+	// Corrupt pieces are refused, and leave the board as it was.
+	BoardImage before;
+	board_save(restored, &before);
+	BoardImage bad = image;
+	bad.piece_type = PIECE_TYPE_COUNT;
+	fail_if (board_restore(restored, &bad), "Unknown piece types are rejected");
+	bad = image;
+	bad.piece_rotation = 4;
+	fail_if (board_restore(restored, &bad), "Rotations past 3 are rejected");
+	bad = image;
+	bad.piece_blocks[3][1] += HEIGHT;
+	fail_if (board_restore(restored, &bad), "Blocks that don't match the piece's shape are rejected");
+	bad = image;
+	bad.piece_y = HEIGHT + 5;
+	fail_if (board_restore(restored, &bad), "Pieces below the board are rejected");
+	bad = image;
+	bad.is_done = 0;
+	bad.piece_x = WIDTH / 2;
+	bad.piece_y = HEIGHT / 2;
+	for (int y=2; y<HEIGHT; y++) {
+		bad.cells[y] = 01111111111u;
+	}
+	fail_if (board_restore(restored, &bad), "Live pieces overlapping blocks are rejected");
+	BoardImage after;
+	board_save(restored, &after);
+	fail_unless (memcmp(&before, &after, sizeof(BoardImage)) == 0, "Refused images leave the board alone");
+	fail_unless (board_restore(restored, &image), "The untouched image still restores");
+	board_free(original);
+	board_free(restored);
+}
+END_TEST
+
+/** Lock each piece of the solution in turn. Returns whether that empties the board. */
+static bool solver_replay(Board * b, const int * sequence, SolverSolution * solution)
+{
+	for (int i=0; i<solution->count; i++) {
+		Piece * p = piece_create_type(sequence[i], WIDTH / 2, 2);
+		movegen_apply(p, &solution->placements[i]);
+		if (!board_check_valid_placement(b, p)) {
+			piece_free(p);
+			return false;
+		}
+		board_lock_piece(b, p);
+		piece_free(p);
+	}
+	for (int x=0; x<WIDTH; x++){
+		for (int y=0; y<HEIGHT; y++){
+			if (board_cell(b, x, y) != 0) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+START_TEST (solver_test)
+{
+	const int squares[5] = {PIECE_SQUARE, PIECE_SQUARE, PIECE_SQUARE, PIECE_SQUARE, PIECE_SQUARE};
+	Board * b = board_create_seeded(1);
+	SolverSolution solution;
+	fail_unless (solver_find_perfect_clear(b, squares, 5, 2, &solution), "Five squares fill two rows");
+	fail_unless (solution.count == 5 && solution.height == 2, "Five squares fill two rows");
+	fail_unless (solver_replay(b, squares, &solution), "The solution should empty the board");
+	fail_if (solver_find_perfect_clear(b, squares, 4, 2, &solution), "Four squares leave a gap");
+
+	// Ten squares could also fill four rows, but the lowest clear wins whatever the thread count.
+	const int more_squares[10] = {
+		PIECE_SQUARE, PIECE_SQUARE, PIECE_SQUARE, PIECE_SQUARE, PIECE_SQUARE,
+		PIECE_SQUARE, PIECE_SQUARE, PIECE_SQUARE, PIECE_SQUARE, PIECE_SQUARE
+	};
+	for (int threads=1; threads<=4; threads++) {
+		fail_unless (solver_find_perfect_clear(b, more_squares, 10, threads, &solution), "Squares fill two rows");
+		fail_unless (solution.count == 5 && solution.height == 2, "The lowest clear is found first");
+	}
+
+	const int lines[3] = {PIECE_LINE, PIECE_LINE, PIECE_LINE};
+	for (int x=0; x<WIDTH - 4; x++) {
+		board_set_cell(b, x, HEIGHT - 1, PALETTE_SIZE - 1);
+	}
+	fail_unless (solver_find_perfect_clear(b, lines, 3, 2, &solution), "A flat line finishes the row");
+	fail_unless (solution.count == 1 && solution.height == 1, "A flat line finishes the row");
+	fail_unless (solver_replay(b, lines, &solution), "The solution should empty the board");
+	board_free(b);
+}
+END_TEST
+
+START_TEST (stats_test)
+{
+	Histogram * all = calloc(1, sizeof(Histogram));
+	Histogram * odd = calloc(1, sizeof(Histogram));
+	for (uint32_t v=1; v<=10000; v++) {
+		histogram_record(v % 2 ? odd : all, v);
+	}
+	histogram_merge(all, odd);
+	fail_unless (all->count == 10000 && all->min == 1 && all->max == 10000, "Merging adds the counts up");
+	uint32_t median = histogram_quantile(all, 0.5);
+	fail_unless (median > 5000 - 5000 / HISTOGRAM_SUB_COUNT && median < 5000 + 5000 / HISTOGRAM_SUB_COUNT, 
+				 "Quantiles should be within a bucket");
+	fail_unless (histogram_quantile(all, 1.0) == 10000, "The top quantile is the largest value");
+	fail_unless (histogram_quantile(odd, 0.0) == 1, "Small values are exact");
+	free(all);
+	free(odd);
+
+	GameStats * stats = malloc(sizeof(GameStats));
+	stats_init(stats);
+	Board * b = board_create_seeded(5);
+	StatsRecorder recorder;
+	stats_recorder_attach(&recorder, stats, b);
+	for (int i=0; i<3; i++) {
+		board_reset(b, 5 + i);
+		while (!b->is_done) {
+			board_push_current_piece_down(b);
+		}
+	}
+	board_reset(b, 9);
+	ai_play_game(b, &AI_DEFAULT_WEIGHTS, 40);
+	stats_recorder_stop(&recorder, b);
+	fail_unless (stats->games == 4 && stats->stopped == 1, "Every game should be counted once");
+	fail_unless (stats->top_outs[TOP_OUT_SPAWN_BLOCKED] == 3, "Dropping pieces in the middle tops out");
+	fail_unless (stats->length.max == 40, "The AI game was stopped after 40 pieces");
+
+	uint64_t pieces = 0;
+	for (int t=0; t<PIECE_TYPE_COUNT; t++) {
+		pieces += stats->pieces[t];
+	}
+	fail_unless (pieces == stats->length.sum, "Every lock should be counted");
+
+	// Clears bigger than a tetris, and pieces of no known type, stay within their counts.
+	GameStats * big = malloc(sizeof(GameStats));
+	stats_init(big);
+	board_reset(b, 3);
+	stats_recorder_attach(&recorder, big, b);
+	for (int y=HEIGHT - 6; y<HEIGHT; y++) {
+		for (int x=0; x<WIDTH; x++) {
+			board_set_cell(b, x, y, PALETTE_SIZE - 1);
+		}
+	}
+	Piece * odd_piece = square(0, 0);
+	odd_piece->type = PIECE_TYPE_COUNT;
+	board_lock_piece(b, odd_piece);
+	piece_free(odd_piece);
+	fail_unless (big->clears[STATS_CLEAR_BUCKETS - 1] == 1, "Six rows count as a 4+ row clear");
+	for (int t=0; t<PIECE_TYPE_COUNT; t++) {
+		fail_unless (big->pieces[t] == 0, "Unknown piece types aren't counted");
+	}
+	for (int c=0; c<TOP_OUT_CAUSE_COUNT; c++) {
+		fail_unless (big->top_outs[c] == 0, "Clears don't spill into other counts");
+	}
+	board_set_listener(b, NULL, NULL);
+	free(big);
+
+	FILE * file = tmpfile();
+	GameStats * loaded = malloc(sizeof(GameStats));
+	fail_unless (stats_write(stats, file), "The report should be written");
+	rewind(file);
+	fail_unless (stats_read(loaded, file), "The report should be read back");
+	fail_unless (memcmp(stats, loaded, sizeof(GameStats)) == 0, "Reports should read back unchanged");
+	fclose(file);
+	free(loaded);
+	free(stats);
+	board_free(b);
+}
+END_TEST
+
+
+
 
 
 Suite *
@@ -235,6 +799,19 @@ full_suite (void)
 	tcase_add_test (tc_core, board_test);
 	tcase_add_test (tc_core, move_piece_test);
 	tcase_add_test (tc_core, test_random_piece);
+	tcase_add_test (tc_core, seeded_board_test);
+	tcase_add_test (tc_core, env_batch_test);
+	tcase_add_test (tc_core, obs_ring_test);
+	tcase_add_test (tc_core, movegen_test);
+	tcase_add_test (tc_core, ai_test);
+	tcase_add_test (tc_core, surface_test);
+	tcase_add_test (tc_core, spectate_test);
+	tcase_add_test (tc_core, term_render_test);
+	tcase_add_test (tc_core, counters_test);
+	tcase_add_test (tc_core, garbage_test);
+	tcase_add_test (tc_core, snapshot_test);
+	tcase_add_test (tc_core, solver_test);
+	tcase_add_test (tc_core, stats_test);
 	suite_add_tcase (s, tc_core);
 	return s;
 }